@@ -296,6 +296,12 @@ The document scanner needs to be modified to interface directly with our system:
    WantedBy=multi-user.target
    ```
 
+   To recover from crashes without reloading every model, set `fork_server_mode` in `config.json` to `per_crash` (one worker, re-forked when it dies) or `per_job` (a fresh worker per scan), and start the fork server instead:
+   ```
+   ExecStart=/usr/bin/python3 -c "import main; main.ForkServer().serve_forever()"
+   ```
+   systemd still restarts the parent if it fails, but worker crashes are handled within milliseconds by the parent. Replacement workers skip the LED self-test and take scans right away, warming each model with a single pass in the background. Missing system audio clips are generated by a short-lived helper process at boot, so the parent never runs inference before forking. That rule has a cost in `per_job` mode: the parent is never warmed up, because OpenMP and runtime thread pools started before `fork()` can hang the child, and a fresh worker does not live long enough to benefit from warming itself. Every scan therefore pays each model's first-inference cost, which is the gap between first and steady-state latency logged during warm-up. Use `per_crash` when scan latency matters, and `per_job` only when a clean process per patient is worth that cost.
+
 2. Enable I2C interface for LCD display:
    ```bash
    sudo armbian-config
@@ -340,16 +346,15 @@ The document scanner needs to be modified to interface directly with our system:
 
 ### Scanner Calibration
 
-1. Run the scanner calibration utility:
+1. Place a calibration target on the glass: a white page with a solid black patch (a printed page with a filled black square works). Then run the scanner calibration:
    ```bash
    cd ~/medical-imaging-ai
-   python3 tools/calibrate_scanner.py
+   python3 -c "import main; main.calibrate_scanner()"
    ```
+   This measures the black and white levels of each colour channel and saves a lookup table for this scanner under `calibration_path` (`./calibration/<device>.npy`). The table corrects brightness, contrast and colour cast. It is applied to every scan band as it arrives, so OCR and the models always see normalized input. Repeat after replacing the scanner or its lamp.
 
 2. Follow the on-screen instructions to:
-   - Adjust brightness and contrast
    - Set the scan area dimensions
-   - Calibrate color accuracy
    - Test scan speed and resolution
 
 ### System Testing
@@ -374,6 +379,13 @@ The document scanner needs to be modified to interface directly with our system:
    python3 tools/run_sample_tests.py
    ```
 
+4. Load-test the pipeline without the scanner, button or speaker:
+   ```bash
+   cd ~/medical-imaging-ai
+   python3 -c "import main; main.run_replay_load(scans=50)"
+   ```
+   Setting `hardware_backend` to `replay` swaps the scanner for one that replays the sample images, waiting `replay_latency_s` per scan and transferring at `replay_mb_per_s`, and replaces GPIO with a recorder. The command above pushes scans through the full button flow back to back (pass `interval_s` to space them out, or `through="analyze"` to skip the audio prompts) and saves throughput, failures and latency percentiles to `results/replay_load.json`. Known limitation: this source tree does not yet include the per-modality analyzers (`_analyze_xray`, `_analyze_text_report`, ...), `generate_and_play_result` or `_translate_text`, and startup needs `models/medical_terminology.json` in place. Until those are present, every replayed scan fails at the analysis step and is counted under `failures`, so the report measures scanning, preprocessing and type detection only.
+
 ### Performance Optimization
 
 1. Adjust system configuration for better performance:
@@ -384,11 +396,67 @@ The document scanner needs to be modified to interface directly with our system:
    
    Optimize these settings:
    - `scan_resolution`: Lower for faster scanning (e.g., 200 DPI)
+   - `adf_batch_mode`: With a scanner that has a document feeder, one button press scans the whole stack (up to `max_batch_pages`). Pages are analyzed while the remaining ones are still being fed, `page_analysis_workers` at a time, and the findings are read out as one page-by-page summary
+   - `quality_gate` / `quality_limits`: Check every scan for blur, over- and underexposure, blank pages and heavy rotation before any OCR or model runs. Rejected scans light the error LED and play a prompt asking the patient to place the document flat and scan again. The measured values are logged with each scan, which helps when tuning the limits. With `streaming_scan`, OCR of the top of the page waits until the rows scanned so far pass the check, so a rejected page costs little or no OCR. In `adf_batch_mode`, a rejected page is listed under `rejected_pages` and the rest of the stack is still analyzed; the rescan prompt plays after the results
+   - `auto_crop` / `crop_max_skew`: Crop each scan to the document and straighten it before analysis, so a small ECG strip or lab slip isn't processed with the empty bed around it. `python3 -c "import main; main.crop_statistics()"` reports the pixels saved per sample image in `results/crop_statistics.json`, and lists any sample whose crop would cut off part of the document under `lost_ink`
+   - `multi_document_scan`: Find separate documents on the bed, for example a blood report and an ECG strip placed side by side, and analyze each one concurrently. Results come back in reading order, top to bottom. Keep documents at least an inch apart; `min_document_area` sets the smallest slip that counts as its own document
+   - `scan_profiles`: Named scanner settings (resolution, `color_mode` and `bit_depth`). Printed reports default to 200 DPI 8-bit grayscale, film and ECG paper to 300 DPI grayscale; set an ECG `bit_depth` of 1 to keep only the trace. The scanner session is configured once and only the settings that differ are changed between scans
+   - `scan_profile_switch_pins`: Map profile names to the GPIO pins of a modality selector switch (wired like the button, to ground) to choose the profile by hand
+   - `adaptive_scan`: When no switch position is selected, take a quick pass with the `preview` profile first and rescan with the profile matching the document class (`text_report`, `film` or `ecg`). Scan time and the bytes actually received per document class (next to what a single default-profile pass of the same page would have sent) are appended to `results/scan_stats.jsonl`; summarize them with `python3 -c "import main; main.summarize_scan_stats()"`. `python3 -c "import main; main.preview_statistics()"` checks the preview classifier on the sample images (`results/preview_statistics.json`). With each sample filling the bed width, all 48 are classified correctly (film 33/33, ECG 9/9, reports 6/6), and the two passes send 60% fewer bytes than one default pass for film and ECG and 79% fewer for reports. For slips half the bed width, film and reports stay at 100%, but ECG drops to 6/9: the grey and pale pink grids of samples 4, 6 and 9 are too faint at 75 dpi, so those strips get the report profile. Select the ECG position on the modality switch for small strips
+   - `ocr_language`: Tesseract language(s) the reports are printed in, for example `eng+tam` (install the matching `tesseract-ocr-*` packages). Each scan is OCR'd at most once; the words, their positions and confidences are shared by document type detection, the report analyzer and the API fallback
+   - `roi_type_detection`: Find the modality keyword (X-RAY, MRI, COMPUTED TOMOGRAPHY, ...) by reading the header band first (`roi_header_fraction` of the page), then the footer band, and the rest of the page only if neither names one. Lab reports end up read in full once, in three pieces. `python3 -c "import main; main.roi_ocr_report()"` compares latency and accuracy against full-page OCR on the sample images in `results/roi_ocr_report.json`
+   - `ocr_workers` / `ocr_tile_overlap`: Full-page OCR splits the page into overlapping horizontal tiles, one per worker (defaults to the number of CPU cores), and reads them at the same time. Words read twice where tiles overlap are kept once. Keep the overlap above one text line height at the scan resolution. `python3 -c "import main; main.ocr_scaling_report()"` times the sample lab reports at 1, 2, 4 and 8 workers and writes `results/ocr_scaling_report.json`
    - `use_gpu`: Set to `true` if GPU acceleration is available
    - `batch_size`: Adjust based on available memory
    - `audio_quality`: Adjust for balance between quality and speed
+   - `streaming_scan`: With a scanner driver that delivers the page in bands (`scan_bands`), OCR and document type detection run on the top of the page while the rest is still being scanned, and the detected modality's model starts loading before the scan finishes. Chunks are read in parallel on the OCR thread pool (`ocr_workers`). The type classifier still makes the call when the page is complete; if it confidently finds an imaging modality, the remaining OCR is skipped, and otherwise the streamed text is reused for keyword detection and the report analyzers. Chunks are read as acquired; the page is deskewed as a whole by `auto_crop` afterwards. `streaming_ocr_rows` and `streaming_ocr_overlap` control the OCR chunk size
+   - `lazy_model_loading`: Load each model the first time its document type is scanned
+   - `model_weight_budget_mb`: Memory allowed for the weights of loaded models; least recently used models are unloaded beyond this (0 = no limit). Sizes are estimated from the weights (or model files), not measured RSS, so leave headroom for runtimes, tokenizers and image processors
+   - `parallel_startup` / `startup_workers`: Load models, tokenizers and translators concurrently at boot. Per-artifact load times are written to the log after startup
+   - `warmup_on_start` / `warmup_iterations` / `warmup_models`: Run a synthetic input through every loaded model and OCR before accepting scans. With `lazy_model_loading`, the modalities in `warmup_models` are loaded at boot so they can be warmed; the rest still load and pay their first inference on first use. Button presses during startup play a "please wait" prompt. First versus steady-state latency per model is logged
+   - `audio_cache_path`: Pre-generated system prompts are kept here between restarts and only regenerated when a message, language or `tts_tld` voice changes. Once the cache is warm, startup needs no network access for audio
+
+2. Pack all local model weights into one memory-mapped file (optional):
+   ```bash
+   cd ~/medical-imaging-ai
+   python3 -c "import main; main.pack_model_weights()"
+   ```
+   Then set `use_weight_pack` to `true`. PyTorch models read their weights straight from the mapped file, so cold start only touches the pages it needs and several processes share the same memory. Keras models (CT, ECG) still copy their weights on load. Re-run the command whenever a model is updated.
+
+3. Run every model through ONNX Runtime instead of TensorFlow and PyTorch (optional):
+   ```bash
+   pip3 install onnxruntime tf2onnx optimum[onnxruntime]
+   cd ~/medical-imaging-ai
+   python3 -c "import main; main.export_onnx_models()"
+   python3 -c "import main; main.benchmark_inference_backends()"
+   ```
+   The benchmark compares peak memory and per-image latency of both backends on the sample images and saves `results/backend_benchmark.json`. If ONNX wins, set `inference_backend` to `onnx` and size its thread pool with `onnx_threads`. TensorFlow is then never imported; PyTorch stays loaded for the translators.
 
-2. Monitor system performance:
+4. Use int8 models on CPU-only boards (optional, requires step 3's export):
+   ```bash
+   cd ~/medical-imaging-ai
+   python3 -c "import main; main.quantize_models()"
+   python3 -c "import main; main.quantization_report()"
+   ```
+   The report (`results/quantization_report.json`) lists, per modality, how often the int8 model agrees with the fp32 model on the sample images and the latency of each. Enable the modalities that hold up under `quantized_models` in `config.json`; those run through ONNX Runtime even when `inference_backend` is `native`. Set `gpu_enabled` to `false` on boards without a usable GPU.
+
+5. Detect the document type without OCR:
+   ```bash
+   cd ~/medical-imaging-ai
+   python3 -c "import main; main.train_type_classifier()"
+   python3 -c "import main; main.type_detection_report()"
+   ```
+   Trains a small image classifier on the sample report folders and saves it to `type_classifier_path`. Scans are then typed from their layout in tens of milliseconds, and OCR keyword matching only runs when the classifier's confidence is below `confidence_threshold`. The report (`results/type_detection_report.json`) compares accuracy and latency of the classifier, OCR keywords and the combination on the sample images, each classified by a model that was trained without it. Retrain whenever sample folders are added; set `type_classifier` to `false` to go back to OCR only.
+
+6. Check where startup time goes:
+   Every boot writes `boot_profile.json` next to `medical_imaging_system.log`, with the start and duration of each phase (hardware self-test, each model and translator load, each gTTS call, warm-up), and appends it to `boot_profiles.jsonl`. Before a release, compare against the previous release's profile:
+   ```bash
+   cd ~/medical-imaging-ai
+   python3 -c "import main; print(main.compare_boot_profiles('boot_profile.v4.1.0.json'))"
+   ```
+   Phases that got more than 20% (and 0.25 s) slower are listed and logged as warnings.
+
+7. Monitor system performance:
    ```bash
    cd ~/medical-imaging-ai
    python3 tools/performance_monitor.py
@@ -521,10 +589,17 @@ You can integrate your own custom-trained models for specific medical imaging ta
      {
        "name": "custom_lung_nodule_detector",
        "config_file": "models/custom/my_model_config.json",
-       "document_types": ["xray_chest"]
+       "document_types": ["xray"]
      }
    ]
    ```
+   `document_types` lists detected document types (`xray`, `mri`, `ct`, `ecg`, `ultrasound`, `text_report`) that should be analyzed by this model instead of the built-in one. Custom models load the first time a matching document is scanned.
+
+5. To roll out a new version of a custom model, copy the new model file next to the old one, point `model_file` in its configuration file at it, and reload the service:
+   ```bash
+   sudo systemctl reload medical-imaging.service
+   ```
+   The new version is loaded in the background and swapped in without restarting; if it fails to load, the current version stays in service. To retire a custom model, remove its entry from `custom_models` or delete its configuration file and reload; it is unloaded and its document types go back to the built-in models. Add `ExecReload=/bin/kill -HUP $MAINPID` to the `[Service]` section of the unit file for this to work. Under the fork server, the parent reloads for future workers and passes the signal on to the running `per_crash` worker, which reloads its own copy; in `per_job` mode a scan already in progress finishes with the previous version.
 
 ### Multi-language Support Extension
 
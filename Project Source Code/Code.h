@@ -28,19 +28,49 @@ import sys
 import time
 import logging
 import argparse
+import gc
+import hashlib
+import mmap
+import struct
+import warnings
+import statistics
+import signal
+import shutil
+import socket
+import re
+from datetime import datetime
+import importlib
+import itertools
+import resource
+import multiprocessing
+from types import SimpleNamespace
+import threading
+from collections import Counter, OrderedDict, namedtuple, deque
+from contextlib import contextmanager, nullcontext
+from functools import partial
 import numpy as np
-import tensorflow as tf
 import cv2
 import torch
 from PIL import Image
-from transformers import AutoModelForImageClassification, ViTImageProcessor
+from transformers import AutoModelForImageClassification, ViTImageProcessor, AutoConfig
 from transformers import AutoModelForSeq2SeqLM, AutoTokenizer
 import pytesseract
 from gtts import gTTS
 import pygame
 import json
 import requests
-from concurrent.futures import ThreadPoolExecutor
+from concurrent.futures import Future, ThreadPoolExecutor
+
+class _LazyModule:
+    """Defer importing a heavy module until it is first used"""
+    def __init__(self, name):
+        self._name = name
+    
+    def __getattr__(self, attr):
+        return getattr(importlib.import_module(self._name), attr)
+
+# TensorFlow only backs the native CT/ECG models, so the ONNX backend never loads it
+tf = _LazyModule("tensorflow")
 
 # Configure logging
 logging.basicConfig(
@@ -54,84 +84,2100 @@ logging.basicConfig(
 
 logger = logging.getLogger("MedicalImagingAI")
 
+# Tiled OCR runs one Tesseract process per core, so each must stay single-threaded.
+# pytesseract passes its module's environ to every tesseract it starts; giving it its
+# own copy keeps the limit out of this process, where libgomp would apply it to torch
+if hasattr(pytesseract.pytesseract, "environ"):
+    pytesseract.pytesseract.environ = {"OMP_THREAD_LIMIT": "1", **os.environ}
+else:
+    logger.warning("Cannot limit Tesseract threads with this pytesseract version, tiled OCR may oversubscribe the CPU")
+
+SYSTEM_VERSION = "4.1.0"
+
 # Configuration
 CONFIG = {
     "api_endpoint": "https://api.medicalimaging.ai/v1/analyze",
     "api_key": os.environ.get("MEDICAL_AI_API_KEY", "your_api_key_here"),
     "scanner_device": "/dev/ttyUSB0",
+    "calibration_path": "./calibration",  # one lookup table per scanner, see calibrate_scanner
+    "hardware_backend": "device",  # "device", or "replay" to run without scanner, GPIO and speaker
+    "replay_latency_s": 2.0,  # before the first row of each replayed scan
+    "replay_mb_per_s": 6.0,  # replayed scan transfer rate
+    "replay_feeder_pages": 3,  # pages per replayed document feeder batch
     "models_path": "./models",
     "temp_path": "./temp",
     "output_path": "./results",
     "supported_languages": ["english", "tamil", "malayalam"],
     "default_language": "english",
     "confidence_threshold": 0.75,
+    "ocr_language": "eng",  # Tesseract language(s) reports are printed in, e.g. "eng+tam"
+    "ocr_workers": os.cpu_count() or 1,  # horizontal tiles of a page OCR'd concurrently
+    "ocr_min_tile_rows": 400,  # shorter pages use fewer tiles
+    "ocr_tile_overlap": 60,  # rows each tile reads past its edges, at least one text line
+    "roi_type_detection": True,  # OCR the header band, then the footer, before the rest of the page
+    "roi_header_fraction": 0.2,  # of the page height
+    "roi_footer_fraction": 0.1,
+    "roi_overlap_fraction": 0.03,  # bands overlap by at least two text lines so cut lines are read whole
+    "type_classifier": True,  # CNN picks the document type, OCR keywords only below confidence_threshold
+    "type_classifier_path": "./models/type_classifier.pt",  # see train_type_classifier
     "scan_resolution": 300,  # DPI
+    "quality_gate": True,  # reject unusable scans before OCR and inference
+    "quality_limits": {
+        "min_sharpness": 20.0,  # mean horizontal second derivative of the sharpest 0.2% of pixels
+        "max_dark_level": 200,  # darkest 0.1% of pixels, ink fades above this when washed out
+        "min_bright_level": 60,  # brightest 1% of pixels, lower means lid open or lamp failure
+        "min_ink": 0.001,  # fraction of pixels clearly apart from the page, blank below
+        "max_skew": 20.0  # degrees
+    },
+    "auto_crop": True,  # crop to the document and straighten it before analysis
+    "multi_document_scan": False,  # analyze separate slips on the bed one by one
+    "min_document_area": 0.05,  # smallest separate document, as a fraction of the scan
+    "crop_max_skew": 15.0,  # degrees, larger detected rotations are left alone
+    "adaptive_scan": False,  # quick preview pass picks the scan profile per document
+    "scan_profiles": {  # named by preview class (see _classify_preview), bit depth per channel
+        "preview": {"resolution": 75, "color_mode": "color", "bit_depth": 8},
+        "text_report": {"resolution": 200, "color_mode": "gray", "bit_depth": 8},
+        "film": {"resolution": 300, "color_mode": "gray", "bit_depth": 8},  # X-ray, MRI, CT and ultrasound prints
+        "ecg": {"resolution": 300, "color_mode": "gray", "bit_depth": 8}  # bit_depth 1 keeps only the trace
+    },
+    "scan_profile_switch_pins": {},  # profile name -> GPIO pin of a modality switch position
+    "streaming_scan": True,
+    "scan_band_height": 128,  # rows delivered per band by the scanner driver
+    "streaming_ocr_rows": 600,  # rows per OCR chunk during a streaming scan
+    "streaming_ocr_overlap": 60,  # rows shared between consecutive OCR chunks
     "max_scan_size": (8.5, 14),  # inches
+    "adf_batch_mode": False,  # scan the whole stack in the document feeder per button press
+    "max_batch_pages": 50,
+    "page_analysis_workers": 4,  # pages analyzed concurrently in batch mode
     "server_mode": False,
     "gpu_enabled": True,
     "batch_size": 1,
     "use_local_models": True,
     "use_api_fallback": True,
+    "lazy_model_loading": True,
+    "parallel_startup": True,
+    "startup_workers": 4,
+    "warmup_on_start": True,
+    "warmup_iterations": 3,
+    "warmup_models": ["xray", "text_report"],  # loaded at boot for warm-up even with lazy loading
+    "inference_backend": "native",  # "native" or "onnx"
+    "onnx_models_path": "./models/onnx",
+    "onnx_threads": 4,
+    "quantized_models": {  # use the int8 ONNX variant per modality
+        "xray": False,
+        "mri": False,
+        "ct": False,
+        "ecg": False,
+        "text_report": False
+    },
+    "custom_models": [],  # see "Custom Model Integration" in the setup guide
+    "sample_images_path": "./Test_Reports_and_Audio_Samples/Sample_Medical_Report_Images",
+    "fork_server_mode": "off",  # "off", "per_crash" or "per_job"
+    "fork_server_restart_delay": 1.0,  # seconds, when a worker crashes right after starting
+    "model_weight_budget_mb": 3072,  # estimated weight bytes of resident models (not RSS), 0 = unlimited
+    "use_weight_pack": False,
+    "weight_pack_path": "./models/weights.pack",
     "audio_volume": 0.8,
+    "audio_cache_path": "./cache/system_audio",
+    "tts_tld": "com",  # gTTS accent/voice
     "button_gpio_pin": 17,
     "led_status_pin": 27,
     "led_error_pin": 22
 }
 
+def _path_nbytes(path):
+    """Size of a model file or directory on disk"""
+    if os.path.isfile(path):
+        return os.path.getsize(path)
+    total = 0
+    for root, _, files in os.walk(path):
+        total += sum(os.path.getsize(os.path.join(root, name)) for name in files)
+    return total
+
+def _model_nbytes(obj):
+    """Estimate the resident size of a loaded model from its weights"""
+    if isinstance(obj, torch.nn.Module):
+        tensors = list(obj.parameters()) + list(obj.buffers())
+        return sum(t.numel() * t.element_size() for t in tensors)
+    if "tensorflow" in sys.modules and isinstance(obj, tf.keras.Model):
+        return sum(w.nbytes for w in obj.get_weights())
+    if isinstance(obj, OnnxModel):
+        return _path_nbytes(obj.path)
+    return 0
+
+class BootProfiler:
+    """Record nested startup phase timings and write them as a boot profile"""
+    def __init__(self):
+        # Spans use the monotonic clock so an NTP step during boot can't skew them
+        self.boot_time = time.perf_counter()
+        self.spans = []
+        self._local = threading.local()
+        self._lock = threading.Lock()
+    
+    @contextmanager
+    def phase(self, name, absolute=False):
+        """Time a block; nested phases on the same thread get dotted names
+        
+        absolute=True keeps the name as given, for steps that may run on any thread.
+        """
+        stack = self._local.__dict__.setdefault("stack", [])
+        stack.append(name)
+        full_name = name if absolute else ".".join(stack)
+        start = time.perf_counter()
+        try:
+            yield
+        finally:
+            stack.pop()
+            with self._lock:
+                self.spans.append({
+                    "name": full_name,
+                    "start_s": round(start - self.boot_time, 4),
+                    "duration_s": round(time.perf_counter() - start, 4),
+                    "thread": threading.current_thread().name
+                })
+    
+    def run(self, name, fn, *args, **kwargs):
+        with self.phase(name):
+            return fn(*args, **kwargs)
+    
+    def write(self, path, **extra):
+        """Write the profile as JSON and append it to the profile history next to it"""
+        profile = {
+            "version": SYSTEM_VERSION,
+            "host": socket.gethostname(),
+            "created": datetime.now().isoformat(timespec="seconds"),
+            "total_s": round(time.perf_counter() - self.boot_time, 4),
+            "spans": sorted(self.spans, key=lambda span: span["start_s"]),
+            **extra
+        }
+        with open(path, "w") as f:
+            json.dump(profile, f, indent=2)
+        with open(os.path.join(os.path.dirname(path), "boot_profiles.jsonl"), "a") as f:
+            f.write(json.dumps(profile) + "\n")
+        logger.info(f"Boot profile written to {path} ({profile['total_s']:.1f}s total)")
+
+def _boot_profile_path():
+    """Boot profiles live next to the log file"""
+    for handler in logging.getLogger().handlers:
+        if isinstance(handler, logging.FileHandler):
+            return os.path.join(os.path.dirname(handler.baseFilename), "boot_profile.json")
+    return "boot_profile.json"
+
+def _profile_durations(profile):
+    durations = {"total": profile["total_s"]}
+    for span in profile["spans"]:
+        durations[span["name"]] = durations.get(span["name"], 0) + span["duration_s"]
+    return durations
+
+def compare_boot_profiles(baseline_path, current_path=None, tolerance=0.2, min_delta_s=0.25):
+    """List phases that got slower than the baseline by more than tolerance and min_delta_s"""
+    with open(baseline_path, "r") as f:
+        baseline = _profile_durations(json.load(f))
+    with open(current_path or _boot_profile_path(), "r") as f:
+        current = _profile_durations(json.load(f))
+    
+    regressions = []
+    for name, seconds in current.items():
+        if name not in baseline:
+            continue
+        delta = seconds - baseline[name]
+        if delta > min_delta_s and delta > baseline[name] * tolerance:
+            regressions.append({"name": name, "baseline_s": baseline[name], "current_s": seconds, "delta_s": delta})
+    
+    for regression in sorted(regressions, key=lambda r: -r["delta_s"]):
+        logger.warning(
+            f"Startup regression in {regression['name']}: "
+            f"{regression['baseline_s']:.2f}s -> {regression['current_s']:.2f}s"
+        )
+    return regressions
+
+class ModelManager:
+    """Load modality models on first use and keep their weights within a memory budget
+    
+    Sizes are estimated from weight tensors (or the model files when that
+    isn't possible), so the budget tracks weights rather than process RSS.
+    Loads run outside the manager lock: analyses whose model is resident
+    never wait for another model to load, and concurrent requests for the
+    same model share one load.
+    """
+    def __init__(self, owner, budget_mb=0):
+        self.owner = owner
+        self.budget_bytes = int(budget_mb * 1024 * 1024)
+        self._loaders = {}
+        self._sizes = {}  # last known weight size per key, used to evict before loading
+        self._attach = {}  # whether a key's attributes are set on the owner
+        self._resident = OrderedDict()  # key -> loaded attributes, least recently used first
+        self._holds = {}  # key -> number of analyses currently using it
+        self._loading = {}  # key -> Future of a load in progress
+        self._lock = threading.RLock()
+    
+    def register(self, key, loader, size_hint=0, attach=True):
+        """Register a loader returning a dict of attributes to set on the owner
+        
+        With attach=False the attributes are only reachable through get().
+        """
+        self._loaders[key] = loader
+        self._attach[key] = attach
+        self._sizes.setdefault(key, size_hint)
+    
+    def is_registered(self, key):
+        return key in self._loaders
+    
+    def unregister(self, key):
+        """Forget a model, evicting it if resident; analyses already holding it finish with it"""
+        with self._lock:
+            if key in self._resident:
+                self.evict(key)
+            self._loaders.pop(key, None)
+            self._sizes.pop(key, None)
+            self._attach.pop(key, None)
+    
+    def resident_bytes(self):
+        return sum(self._sizes[key] for key in self._resident)
+    
+    def resident_keys(self):
+        return list(self._resident)
+    
+    def ensure(self, key):
+        """Make sure the model for key is resident, loading and evicting as needed"""
+        with self._lock:
+            if key in self._resident:
+                self._resident.move_to_end(key)
+                return
+            
+            loading = self._loading.get(key)
+            if loading is None:
+                loading = self._loading[key] = Future()
+                self._make_room(self._sizes[key])
+                loader = self._loaders[key]
+            else:
+                loader = None
+        
+        # Someone else is loading this model, wait for it (and its error, if any)
+        if loader is None:
+            loading.result()
+            return
+        
+        try:
+            logger.info(f"Loading {key} model on demand")
+            self._admit(key, loader())
+            loading.set_result(None)
+        except BaseException as e:
+            loading.set_exception(e)
+            raise
+        finally:
+            with self._lock:
+                self._loading.pop(key, None)
+    
+    def get(self, key):
+        """Loaded attributes for key, loading them first if needed"""
+        while True:
+            self.ensure(key)
+            with self._lock:
+                if key in self._resident:
+                    return self._resident[key]
+    
+    @contextmanager
+    def hold(self, key):
+        """Keep key from being evicted while the block runs, e.g. during concurrent analyses
+        
+        Held models can push the resident total over the budget, so the
+        budget is enforced again as soon as the last hold on a key ends.
+        """
+        with self._lock:
+            self._holds[key] = self._holds.get(key, 0) + 1
+        try:
+            yield
+        finally:
+            with self._lock:
+                self._holds[key] -= 1
+                if not self._holds[key]:
+                    self._make_room(0)
+    
+    def swap(self, key, loader, size_hint=0):
+        """Replace the model behind key without restarting or a window where it is missing
+        
+        A resident model is loaded in the background first and then switched
+        over atomically; callers already holding the old model finish with it.
+        """
+        if key not in self._resident:
+            with self._lock:
+                self._loaders[key] = loader
+                self._sizes[key] = size_hint
+            logger.info(f"{key} model replaced, new version loads on first use")
+            return
+        
+        attributes = loader()
+        with self._lock:
+            self._loaders[key] = loader
+            self._resident.pop(key, None)
+            self._admit(key, attributes)
+        logger.info(f"{key} model swapped to new version")
+    
+    def _admit(self, key, attributes):
+        """Install freshly loaded model attributes on the owner"""
+        with self._lock:
+            if self._attach[key]:
+                for name, value in attributes.items():
+                    setattr(self.owner, name, value)
+            
+            # Runtimes that hide their weights (e.g. ONNX seq2seq sessions) keep the registered file size
+            self._sizes[key] = sum(_model_nbytes(value) for value in attributes.values()) or self._sizes[key]
+            self._make_room(self._sizes[key])
+            self._resident[key] = attributes
+            
+            logger.info(
+                f"{key} model resident ({self._sizes[key] / 1024 / 1024:.0f} MB, "
+                f"{self.resident_bytes() / 1024 / 1024:.0f} MB total)"
+            )
+    
+    def _make_room(self, nbytes):
+        """Evict least recently used models until nbytes more fits in the budget"""
+        while self.budget_bytes and self.resident_bytes() + nbytes > self.budget_bytes:
+            idle = [key for key in self._resident if not self._holds.get(key)]
+            if not idle:
+                logger.warning("Model memory budget exceeded, every resident model is in use")
+                return
+            self.evict(idle[0])
+    
+    def evict(self, key):
+        """Drop a resident model so its memory can be reclaimed"""
+        with self._lock:
+            attributes = self._resident.pop(key)
+            if self._attach[key]:
+                for name in attributes:
+                    setattr(self.owner, name, None)
+            gc.collect()
+            logger.info(f"Evicted {key} model ({self._sizes[key] / 1024 / 1024:.0f} MB)")
+    
+    def load_all(self, load_artifacts=None):
+        """Load every registered model, optionally through a concurrent artifact loader"""
+        if load_artifacts is None:
+            for key in self._loaders:
+                self.ensure(key)
+            return
+        
+        pending = {key: loader for key, loader in self._loaders.items() if key not in self._resident}
+        for key, attributes in load_artifacts(pending).items():
+            self._admit(key, attributes)
+
+_empty_parameters_state = threading.local()
+_empty_parameters_patch = SimpleNamespace(lock=threading.Lock(), users=0, original=None)
+
+@contextmanager
+def _empty_parameters():
+    """Create module parameters on the meta device while keeping buffers real
+    
+    Only affects the calling thread, so other models can load concurrently.
+    As with accelerate's init_empty_weights, Module.register_parameter is
+    patched only while some thread is inside the block and restored when
+    the last one leaves, so models built afterwards get real parameters.
+    """
+    patch = _empty_parameters_patch
+    with patch.lock:
+        if patch.users == 0:
+            patch.original = original = torch.nn.Module.register_parameter
+            
+            def register_parameter(module, name, param):
+                original(module, name, param)
+                if param is not None and getattr(_empty_parameters_state, "active", False):
+                    module._parameters[name] = torch.nn.Parameter(
+                        param.to("meta"), requires_grad=param.requires_grad)
+            
+            torch.nn.Module.register_parameter = register_parameter
+        patch.users += 1
+    
+    was_active = getattr(_empty_parameters_state, "active", False)
+    _empty_parameters_state.active = True
+    try:
+        yield
+    finally:
+        _empty_parameters_state.active = was_active
+        with patch.lock:
+            patch.users -= 1
+            if patch.users == 0:
+                torch.nn.Module.register_parameter = patch.original
+                patch.original = None
+
+class WeightPack:
+    """Read-only, memory-mapped file holding the weights of every local model
+    
+    Layout: 8-byte magic, little-endian uint64 header length, JSON header,
+    then each tensor starting on its own page. Tensors are handed out as
+    views into the mapping, so worker processes share the same page cache.
+    """
+    MAGIC = b"MIAWPAK1"
+    ALIGNMENT = 4096
+    
+    def __init__(self, path):
+        self.path = path
+        with open(path, "rb") as f:
+            self._mmap = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        
+        magic, header_len = struct.unpack_from("<8sQ", self._mmap, 0)
+        if magic != self.MAGIC:
+            raise ValueError(f"{path} is not a weight pack")
+        self.index = json.loads(self._mmap[16:16 + header_len].decode("utf-8"))
+        self._data_offset = self._align(16 + header_len)
+    
+    @classmethod
+    def _align(cls, offset):
+        return -(-offset // cls.ALIGNMENT) * cls.ALIGNMENT
+    
+    def __contains__(self, key):
+        return key in self.index["models"]
+    
+    def meta(self, key):
+        return self.index["models"][key]["meta"]
+    
+    def arrays(self, key):
+        """Zero-copy numpy views of a model's tensors, in pack order"""
+        arrays = OrderedDict()
+        for name, tensor in self.index["models"][key]["tensors"].items():
+            array = np.frombuffer(
+                self._mmap,
+                dtype=tensor["dtype"],
+                count=int(np.prod(tensor["shape"])),
+                offset=self._data_offset + tensor["offset"]
+            )
+            arrays[name] = array.reshape(tensor["shape"])
+        return arrays
+    
+    def load_torch(self, key, build):
+        """Build a PyTorch model without allocating weights, then point it at the pack"""
+        tensors = self.index["models"][key]["tensors"]
+        with warnings.catch_warnings():
+            # Tensors alias the read-only mapping; inference never writes to them
+            warnings.simplefilter("ignore", UserWarning)
+            state = OrderedDict(
+                (name, torch.from_numpy(array).view(getattr(torch, tensors[name]["torch_dtype"])))
+                for name, array in self.arrays(key).items()
+            )
+        
+        with _empty_parameters():
+            model = build(self.meta(key))
+        model.load_state_dict(state, assign=True)
+        if hasattr(model, "tie_weights"):
+            model.tie_weights()
+        return model.eval()
+    
+    def load_keras(self, key):
+        """Rebuild a Keras model from its packed architecture and weights
+        
+        Keras copies weights into its own variables, so these pages are not shared.
+        """
+        model = tf.keras.models.model_from_json(self.meta(key)["architecture"])
+        model.set_weights(list(self.arrays(key).values()))
+        return model
+    
+    @classmethod
+    def write(cls, path, models):
+        """Write {key: {"meta": dict, "tensors": {name: torch.Tensor or np.ndarray}}} as a pack"""
+        index = {"version": 1, "models": {}}
+        payload = []
+        offset = 0
+        for key, entry in models.items():
+            tensors = OrderedDict()
+            for name, tensor in entry["tensors"].items():
+                torch_dtype = None
+                if isinstance(tensor, torch.Tensor):
+                    torch_dtype = str(tensor.dtype).replace("torch.", "")
+                    tensor = tensor.detach().cpu().contiguous()
+                    if tensor.dtype == torch.bfloat16:
+                        tensor = tensor.view(torch.int16)
+                    tensor = tensor.numpy()
+                array = np.ascontiguousarray(tensor)
+                tensors[name] = {
+                    "offset": offset,
+                    "dtype": array.dtype.str,
+                    "shape": list(array.shape),
+                    "torch_dtype": torch_dtype
+                }
+                payload.append((offset, array))
+                offset = cls._align(offset + array.nbytes)
+            index["models"][key] = {"meta": entry["meta"], "tensors": tensors}
+        
+        header = json.dumps(index).encode("utf-8")
+        data_offset = cls._align(16 + len(header))
+        with open(f"{path}.tmp", "wb") as f:
+            f.write(struct.pack("<8sQ", cls.MAGIC, len(header)))
+            f.write(header)
+            for tensor_offset, array in payload:
+                f.seek(data_offset + tensor_offset)
+                f.write(array.tobytes())
+            f.truncate(data_offset + offset)
+        os.replace(f"{path}.tmp", path)
+        logger.info(f"Wrote weight pack {path} ({(data_offset + offset) / 1024 / 1024:.0f} MB)")
+
+def _native_offline_system(config=None):
+    """Offline instance loading the plain fp32 models, for the tools that convert them
+    
+    Quantized variants exist only as ONNX models, so they are switched off
+    along with the ONNX backend.
+    """
+    return MedicalImagingSystem.offline(dict(config or CONFIG, inference_backend="native", quantized_models={}))
+
+def pack_model_weights(config=None):
+    """Convert the configured local models into a single memory-mapped weight pack"""
+    system = _native_offline_system(config)
+    models = {
+        "xray": system._load_xray_model()["xray_model"],
+        "mri": system._load_mri_model()["mri_model"],
+        "ct": system._load_ct_model()["ct_model"],
+        "ecg": system._load_ecg_model()["ecg_model"],
+        "text_report": system._load_report_model()["report_model"]
+    }
+    
+    entries = {}
+    for key, model in models.items():
+        if isinstance(model, torch.nn.Module):
+            meta = {"config": model.config.to_dict()} if hasattr(model, "config") else {}
+            entries[key] = {"meta": meta, "tensors": model.state_dict()}
+        else:
+            weights = model.get_weights()
+            entries[key] = {
+                "meta": {"architecture": model.to_json()},
+                "tensors": OrderedDict((f"{i:04d}", w) for i, w in enumerate(weights))
+            }
+    
+    WeightPack.write(system.config["weight_pack_path"], entries)
+
+# Sample folders and the document type each one holds
+SAMPLE_FOLDER_TYPES = {
+    "X-Ray Reports": "xray",
+    "MRI Reports": "mri",
+    "CT scan Reports": "ct",
+    "ECG Reports": "ecg",
+    "Ultrasound Reports": "ultrasound",
+    "Blood Test Reports": "text_report"
+}
+
+def _iter_sample_images(sample_path):
+    """Yield (document type, image path) for every image in the sample corpus"""
+    for folder, doc_type in SAMPLE_FOLDER_TYPES.items():
+        folder_path = os.path.join(sample_path, folder)
+        if not os.path.isdir(folder_path):
+            continue
+        for name in sorted(os.listdir(folder_path)):
+            if name.lower().endswith((".jpg", ".jpeg", ".png", ".bmp")):
+                yield doc_type, os.path.join(folder_path, name)
+
+def _load_samples(config):
+    """Sample image paths per document type, for the model benchmarks
+    
+    Text generation ignores the image, so text reports are timed on one page.
+    """
+    samples = {}
+    for doc_type, path in _iter_sample_images(config["sample_images_path"]):
+        samples.setdefault(doc_type, []).append(path)
+    samples["text_report"] = samples.get("text_report", [])[:1]
+    return samples
+
+def _save_report(config, name, report, title):
+    """Write an offline tool's report to <output_path>/<name>.json"""
+    report_path = f"{config['output_path']}/{name}.json"
+    os.makedirs(config["output_path"], exist_ok=True)
+    with open(report_path, "w") as f:
+        json.dump(report, f, indent=2)
+    logger.info(f"{title} saved to {report_path}")
+
+def _onnx_session_options(config):
+    """Session options shared by every ONNX model
+    
+    ONNX Runtime's Python API has no global thread pool, so every session
+    gets the same small intra-op pool with spinning disabled; analyses run
+    one at a time, so idle pools cost no CPU.
+    """
+    import onnxruntime as ort
+    options = ort.SessionOptions()
+    options.intra_op_num_threads = config["onnx_threads"]
+    options.inter_op_num_threads = 1
+    options.execution_mode = ort.ExecutionMode.ORT_SEQUENTIAL
+    options.graph_optimization_level = ort.GraphOptimizationLevel.ORT_ENABLE_ALL
+    options.add_session_config_entry("session.intra_op.allow_spinning", "0")
+    return options
+
+class OnnxModel:
+    """An exported model run through ONNX Runtime behind the native call styles
+    
+    Calling it like a PyTorch module returns a tensor (wrapped with .logits
+    for Hugging Face exports), and predict() mirrors Keras, so analyzers
+    don't care which backend loaded the model.
+    """
+    def __init__(self, path, session_options):
+        import onnxruntime as ort
+        self.path = path
+        self.session = ort.InferenceSession(
+            path, sess_options=session_options, providers=["CPUExecutionProvider"])
+        self.input_names = [i.name for i in self.session.get_inputs()]
+        self.output_names = [o.name for o in self.session.get_outputs()]
+        self.input_shape = tuple(
+            dim if isinstance(dim, int) else None for dim in self.session.get_inputs()[0].shape)
+    
+    def run(self, *args, **kwargs):
+        feeds = dict(zip(self.input_names, args))
+        feeds.update((name, kwargs[name]) for name in self.input_names if name in kwargs)
+        feeds = {
+            name: value.detach().cpu().numpy() if isinstance(value, torch.Tensor) else np.asarray(value)
+            for name, value in feeds.items()
+        }
+        return self.session.run(self.output_names, feeds)
+    
+    def __call__(self, *args, **kwargs):
+        output = torch.from_numpy(self.run(*args, **kwargs)[0])
+        if self.output_names[0] == "logits":
+            return SimpleNamespace(logits=output)
+        return output
+    
+    def predict(self, x, verbose=0):
+        return self.run(np.asarray(x, dtype=np.float32))[0]
+    
+    def eval(self):
+        return self
+
+def export_onnx_models(config=None):
+    """Export every configured local model to ONNX for the onnx inference backend"""
+    system = _native_offline_system(config)
+    onnx_path = system.config["onnx_models_path"]
+    os.makedirs(onnx_path, exist_ok=True)
+    
+    xray_model = system._load_xray_model()["xray_model"]
+    xray_model.config.return_dict = False
+    torch.onnx.export(
+        xray_model, (torch.zeros(1, 3, 224, 224),), f"{onnx_path}/xray.onnx",
+        input_names=["pixel_values"], output_names=["logits"],
+        dynamic_axes={"pixel_values": {0: "batch"}, "logits": {0: "batch"}}, opset_version=17
+    )
+    
+    mri_model = system._load_mri_model()["mri_model"]
+    torch.onnx.export(
+        mri_model, (torch.zeros(1, 3, 224, 224),), f"{onnx_path}/mri.onnx",
+        input_names=["input"], output_names=["output"],
+        dynamic_axes={"input": {0: "batch"}, "output": {0: "batch"}}, opset_version=17
+    )
+    
+    import tf2onnx
+    for key in ("ct", "ecg"):
+        model = getattr(system, f"_load_{key}_model")()[f"{key}_model"]
+        tf2onnx.convert.from_keras(model, opset=17, output_path=f"{onnx_path}/{key}.onnx")
+    
+    from optimum.onnxruntime import ORTModelForSeq2SeqLM
+    ORTModelForSeq2SeqLM.from_pretrained("medical-ai/medrpt-bert-base", export=True) \
+        .save_pretrained(f"{onnx_path}/text_report")
+    
+    logger.info(f"Exported ONNX models to {onnx_path}")
+
+def _benchmark_backend(config, backend, samples):
+    """Load every model on one backend and time it on the samples (runs in its own process)"""
+    config = dict(config, inference_backend=backend, quantized_models={})  # int8 models would bypass the native run
+    system = MedicalImagingSystem.offline(config)
+    rss_before = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+    
+    latencies = {}
+    for key in ("xray", "mri", "ct", "ecg", "text_report"):
+        for name, value in getattr(system, f"_load_{key}_model")().items():
+            setattr(system, name, value)
+        
+        timings = []
+        for path in samples.get(key, []):
+            image = cv2.imread(path)
+            system._run_model_pass(key, image)  # first pass includes one-off setup
+            start = time.time()
+            system._run_model_pass(key, image)
+            timings.append(time.time() - start)
+        if timings:
+            latencies[key] = statistics.median(timings) * 1000
+    
+    return {
+        "peak_rss_mb": resource.getrusage(resource.RUSAGE_SELF).ru_maxrss / 1024,
+        "import_rss_mb": rss_before / 1024,
+        "latency_ms": latencies
+    }
+
+def benchmark_inference_backends(config=None):
+    """Compare RSS and per-image latency of the native and ONNX backends"""
+    config = config or CONFIG
+    samples = _load_samples(config)
+    
+    # Each backend runs in a fresh process so its RSS isn't mixed with the other's
+    report = {}
+    context = multiprocessing.get_context("spawn")
+    for backend in ("native", "onnx"):
+        with context.Pool(1) as pool:
+            report[backend] = pool.apply(_benchmark_backend, (config, backend, samples))
+        logger.info(f"{backend}: peak RSS {report[backend]['peak_rss_mb']:.0f} MB")
+        for key, latency in report[backend]["latency_ms"].items():
+            logger.info(f"  {key:<12} {latency:8.1f} ms/image")
+    
+    _save_report(config, "backend_benchmark", report, "Backend benchmark")
+    return report
+
+def quantize_models(config=None):
+    """Produce dynamic int8 variants of the exported ONNX models"""
+    from onnxruntime.quantization import quantize_dynamic, QuantType
+    config = config or CONFIG
+    onnx_path = config["onnx_models_path"]
+    
+    for key in ("xray", "mri", "ct", "ecg"):
+        quantize_dynamic(f"{onnx_path}/{key}.onnx", f"{onnx_path}/{key}_int8.onnx", weight_type=QuantType.QInt8)
+        logger.info(f"Quantized {key}: {_path_nbytes(f'{onnx_path}/{key}.onnx') / 1024 / 1024:.0f} MB -> "
+                    f"{_path_nbytes(f'{onnx_path}/{key}_int8.onnx') / 1024 / 1024:.0f} MB")
+    
+    # The seq2seq export is a directory of encoder/decoder graphs plus configs
+    shutil.rmtree(f"{onnx_path}/text_report_int8", ignore_errors=True)
+    shutil.copytree(f"{onnx_path}/text_report", f"{onnx_path}/text_report_int8")
+    for name in os.listdir(f"{onnx_path}/text_report_int8"):
+        if name.endswith(".onnx"):
+            graph = f"{onnx_path}/text_report_int8/{name}"
+            quantize_dynamic(graph, f"{graph}.tmp", weight_type=QuantType.QInt8)
+            os.replace(f"{graph}.tmp", graph)
+    logger.info("Quantized text_report")
+
+def _output_scores(output):
+    """Flatten a model pass result (tensor, logits wrapper, Keras array, token ids) to numpy"""
+    output = getattr(output, "logits", output)
+    if isinstance(output, torch.Tensor):
+        output = output.detach().cpu().numpy()
+    return np.asarray(output).reshape(-1)
+
+def quantization_report(config=None):
+    """Compare fp32 and int8 models for agreement and latency on the sample images
+    
+    There are no ground-truth labels for the samples, so accuracy is measured
+    as agreement with the fp32 model's top prediction.
+    """
+    config = config or CONFIG
+    samples = _load_samples(config)
+    
+    # Both sides run on ONNX Runtime so the latency difference is quantization alone
+    fp32_config = dict(config, inference_backend="onnx", quantized_models={})
+    int8_config = dict(config, inference_backend="onnx",
+                       quantized_models={key: True for key in config["quantized_models"]})
+    report = {}
+    for key in ("xray", "mri", "ct", "ecg", "text_report"):
+        if not samples.get(key):
+            continue
+        
+        runs = {}
+        for variant, variant_config in (("fp32", fp32_config), ("int8", int8_config)):
+            system = MedicalImagingSystem.offline(variant_config)
+            for name, value in getattr(system, f"_load_{key}_model")().items():
+                setattr(system, name, value)
+            
+            outputs, timings = [], []
+            for path in samples[key]:
+                image = cv2.imread(path)
+                system._run_model_pass(key, image)
+                start = time.time()
+                outputs.append(_output_scores(system._run_model_pass(key, image)))
+                timings.append(time.time() - start)
+            runs[variant] = {"outputs": outputs, "latency_ms": statistics.median(timings) * 1000}
+            del system
+            gc.collect()
+        
+        pairs = list(zip(runs["fp32"]["outputs"], runs["int8"]["outputs"]))
+        if key == "text_report":
+            agreement = [np.array_equal(fp32, int8) for fp32, int8 in pairs]
+            max_diff = None
+        else:
+            agreement = [np.argmax(fp32) == np.argmax(int8) for fp32, int8 in pairs]
+            max_diff = float(max(np.max(np.abs(fp32 - int8)) for fp32, int8 in pairs))
+        
+        report[key] = {
+            "samples": len(pairs),
+            "top1_agreement": float(np.mean(agreement)),
+            "max_abs_output_diff": max_diff,
+            "fp32_latency_ms": runs["fp32"]["latency_ms"],
+            "int8_latency_ms": runs["int8"]["latency_ms"]
+        }
+        logger.info(
+            f"{key:<12} agreement {report[key]['top1_agreement'] * 100:5.1f}%  "
+            f"fp32 {report[key]['fp32_latency_ms']:7.1f} ms  int8 {report[key]['int8_latency_ms']:7.1f} ms"
+        )
+    
+    _save_report(config, "quantization_report", report, "Quantization report")
+    return report
+
+def _estimate_skew(gray, max_angle=15.0):
+    """Angle in degrees that _rotate_image needs to straighten the text on a page
+    
+    Uses the minimum-area rectangle around all ink pixels on a downscaled
+    copy; angles beyond max_angle are treated as unreliable and ignored.
+    """
+    scale = min(1.0, 800 / max(gray.shape))
+    small = cv2.resize(gray, None, fx=scale, fy=scale, interpolation=cv2.INTER_AREA)
+    _, ink = cv2.threshold(small, 0, 255, cv2.THRESH_BINARY_INV | cv2.THRESH_OTSU)
+    coords = cv2.findNonZero(ink)
+    if coords is None or len(coords) < 50:
+        return 0.0
+    
+    (_, _), (width, height), angle = cv2.minAreaRect(coords)
+    if width < height:
+        angle -= 90
+    if angle < -45:
+        angle += 90
+    elif angle > 45:
+        angle -= 90
+    return float(angle) if abs(angle) <= max_angle else 0.0
+
+def _rotate_image(image, angle):
+    """Rotate an image about its centre, filling uncovered corners with white"""
+    height, width = image.shape[:2]
+    matrix = cv2.getRotationMatrix2D((width / 2, height / 2), angle, 1.0)
+    border = (255,) * (image.shape[2] if image.ndim == 3 else 1)
+    return cv2.warpAffine(image, matrix, (width, height), flags=cv2.INTER_LINEAR, borderValue=border)
+
+def _content_mask(gray, max_side=2048):
+    """Mask of the content on the scanner bed and its scale relative to gray
+    
+    Content is anything noticeably darker than the lid seen at the page
+    border; the mask is None when no lid is visible. Downscaling keeps the
+    darkest pixel of each block, so thin ECG traces and grid lines survive,
+    and only specks of a few pixels (scanner dust) are dropped.
+    """
+    step = max(1, -(-max(gray.shape) // max_side))
+    small = cv2.erode(gray, np.ones((step, step), np.uint8))[step // 2::step, step // 2::step] if step > 1 else gray
+    border = np.concatenate([small[0], small[-1], small[:, 0], small[:, -1]])
+    background = float(np.median(border))
+    if background < 160:
+        return None, 1.0 / step
+    
+    content = (small < background - 25).astype(np.uint8)
+    _, labels, stats, _ = cv2.connectedComponentsWithStats(content, connectivity=8)
+    keep = stats[:, cv2.CC_STAT_AREA] >= 4
+    keep[0] = False
+    return keep[labels].astype(np.uint8) * 255, 1.0 / step
+
+def _document_bounds(gray):
+    """Rotated rectangle ((cx, cy), (w, h), angle) around the document on the scanner bed
+    
+    Returns None for blank pages and when the document fills the bed.
+    """
+    content, scale = _content_mask(gray)
+    if content is None:
+        return None
+    coords = cv2.findNonZero(content)
+    if coords is None or len(coords) < 50:
+        return None
+    
+    # Mask pixels stand for whole blocks, so the rectangle grows by one block
+    (cx, cy), (width, height), angle = cv2.minAreaRect(coords)
+    cx, cy, width, height = cx + 0.5, cy + 0.5, width + 1, height + 1
+    
+    # Sparse content such as a bare ECG trace doesn't outline the page, keep it axis-aligned
+    coarse = min(1.0, 800 / max(content.shape))
+    closed = cv2.morphologyEx(cv2.resize(content, None, fx=coarse, fy=coarse, interpolation=cv2.INTER_AREA),
+                              cv2.MORPH_CLOSE, np.ones((15, 15), np.uint8))
+    if cv2.countNonZero(closed) < 0.25 * width * height * coarse * coarse:
+        x, y, width, height = cv2.boundingRect(coords)
+        cx, cy, angle = x + width / 2, y + height / 2, 0.0
+    return (cx / scale, cy / scale), (width / scale, height / scale), angle
+
+def build_calibration_lut(image, black=8, white=248):
+    """Per-channel levels table from a scan of a calibration target
+    
+    The target needs solid black and plain white areas (a printed page
+    with a black patch does). Each channel's darkest and brightest 0.5% are
+    mapped to black and white, which corrects brightness, contrast and
+    colour cast at once. Rows are B, G, R and gray.
+    """
+    channels = list(cv2.split(image)) if image.ndim == 3 else [image] * 3
+    channels.append(cv2.cvtColor(image, cv2.COLOR_BGR2GRAY) if image.ndim == 3 else image)
+    
+    levels = np.arange(256, dtype=np.float32)
+    lut = np.empty((4, 256), np.uint8)
+    for row, channel in enumerate(channels):
+        cumulative = np.cumsum(cv2.calcHist([channel], [0], None, [256], [0, 256]).ravel()) / channel.size
+        low, high = np.searchsorted(cumulative, [0.005, 0.995])
+        if high - low < 64:
+            raise RuntimeError("Calibration target has too little contrast, it needs black and white areas")
+        lut[row] = np.clip((levels - low) * (white - black) / (high - low) + black, 0, 255)
+    return lut
+
+def _calibration_file(config, device_info):
+    """Lookup table path for a scanner, keyed by its device description"""
+    name = "".join(c if c.isalnum() else "_" for c in str(device_info)).strip("_")
+    return os.path.join(config["calibration_path"], f"{name or 'scanner'}.npy")
+
+def calibrate_scanner(config=None):
+    """Scan a calibration target and save the scanner's lookup table
+    
+    Place a page with solid black and plain white areas on the glass first.
+    The table is applied to every later scan from this device during
+    acquisition.
+    """
+    config = config or CONFIG
+    system = MedicalImagingSystem.offline(config)
+    if config["hardware_backend"] == "replay":
+        system.scanner = ReplayScannerDevice(config)
+    else:
+        system.scanner = ScannerDevice(config["scanner_device"])
+    system.scanner_settings = {}
+    system.calibration = None
+    system._apply_scan_profile("default")
+    
+    os.makedirs(config["temp_path"], exist_ok=True)
+    target = system._scan_page(f"{config['temp_path']}/calibration_target.png")
+    if target is None:
+        raise RuntimeError("Scanner failed to scan the calibration target")
+    
+    lut = build_calibration_lut(target.image)
+    path = _calibration_file(config, system.scanner.get_device_info())
+    os.makedirs(config["calibration_path"], exist_ok=True)
+    np.save(path, lut)
+    logger.info(f"Scanner calibration saved to {path}")
+    return path
+
+class ScanQualityError(RuntimeError):
+    """A scan too blurry, dark, washed out, blank or crooked to be worth analyzing"""
+    def __init__(self, problems, metrics):
+        super().__init__(f"Scan rejected: {', '.join(problems)}")
+        self.problems = problems
+        self.metrics = metrics
+
+def assess_scan_quality(image):
+    """Sharpness, exposure, ink coverage and skew of a scan, in a few milliseconds"""
+    # Every n-th row only reads a fraction of the frame; rows keep their full
+    # resolution so sharpness is judged at the detail OCR actually sees
+    step = -(-max(image.shape[:2]) // 1000)
+    rows = np.ascontiguousarray(image[::step])
+    if rows.ndim == 3:
+        rows = cv2.cvtColor(rows, cv2.COLOR_BGR2GRAY)
+    small = np.ascontiguousarray(rows[:, ::step])
+    
+    # Percentiles from the histogram, sorting a megapixel is slower
+    cumulative = np.cumsum(cv2.calcHist([small], [0], None, [256], [0, 256]).ravel()) / small.size
+    dark_level, median, bright_level = np.searchsorted(cumulative, [0.001, 0.5, 0.99])
+    
+    # Mean of the strongest 0.2% of second derivatives, again read off a histogram
+    edges = cv2.convertScaleAbs(cv2.filter2D(rows, cv2.CV_16S, np.array([[1, -2, 1]], np.float32)))
+    counts = cv2.calcHist([edges], [0], None, [256], [0, 256]).ravel()
+    top = np.minimum(np.cumsum(counts[::-1]), edges.size / 500)
+    strongest = np.diff(top, prepend=0)
+    return {
+        "sharpness": float(np.dot(strongest, np.arange(255, -1, -1)) / top[-1]),
+        "dark_level": int(dark_level),
+        "bright_level": int(bright_level),
+        "ink": float(np.count_nonzero(cv2.absdiff(small, int(median)) > 40) / small.size),
+        "skew": _estimate_skew(small[::3, ::3], max_angle=45.0)  # coarse is plenty for a sanity limit
+    }
+
+def _segment_documents(image, min_area=0.05, gap=0.08):
+    """Boxes (x, y, w, h) of separate documents on the scanner bed, in reading order
+    
+    Content closer together than gap (a fraction of the longer side) counts
+    as one document, so blank lines and columns don't split a page.
+    """
+    gray = cv2.cvtColor(image, cv2.COLOR_BGR2GRAY) if image.ndim == 3 else image
+    content, scale = _content_mask(gray)
+    if content is None:
+        return []
+    
+    # Grouping only needs a coarse copy; any content in a block marks the block
+    coarse = min(1.0, 800 / max(content.shape))
+    content = (cv2.resize(content, None, fx=coarse, fy=coarse, interpolation=cv2.INTER_AREA) > 0).astype(np.uint8) * 255
+    scale *= coarse
+    size = max(3, int(gap * max(content.shape)))
+    blobs = cv2.dilate(content, np.ones((size, size), np.uint8))
+    contours, _ = cv2.findContours(blobs, cv2.RETR_EXTERNAL, cv2.CHAIN_APPROX_SIMPLE)
+    boxes = [list(cv2.boundingRect(contour)) for contour in contours]
+    
+    # Boxes of irregular blobs can still overlap, those belong together
+    merged = True
+    while merged:
+        merged = False
+        for i in range(len(boxes)):
+            for j in range(i + 1, len(boxes)):
+                (x1, y1, w1, h1), (x2, y2, w2, h2) = boxes[i], boxes[j]
+                if x1 < x2 + w2 and x2 < x1 + w1 and y1 < y2 + h2 and y2 < y1 + h1:
+                    x, y = min(x1, x2), min(y1, y2)
+                    boxes[i] = [x, y, max(x1 + w1, x2 + w2) - x, max(y1 + h1, y2 + h2) - y]
+                    del boxes[j]
+                    merged = True
+                    break
+            if merged:
+                break
+    
+    # Judge size on the content itself, dilation inflates small specks
+    documents = []
+    for x, y, w, h in boxes:
+        cx, cy, cw, ch = cv2.boundingRect(cv2.findNonZero(content[y:y + h, x:x + w]))
+        if cw * ch >= min_area * content.shape[0] * content.shape[1]:
+            pad = size // 4
+            x0, y0 = max(0, x + cx - pad), max(0, y + cy - pad)
+            x1, y1 = min(content.shape[1], x + cx + cw + pad), min(content.shape[0], y + cy + ch + pad)
+            documents.append((x0, y0, x1, y1))
+    
+    documents.sort(key=lambda box: (round(box[1] / (0.05 * content.shape[0])), box[0]))
+    height, width = gray.shape
+    return [
+        (int(x0 / scale), int(y0 / scale),
+         min(width, int(x1 / scale)) - int(x0 / scale), min(height, int(y1 / scale)) - int(y0 / scale))
+        for x0, y0, x1, y1 in documents
+    ]
+
+def _crop_transform(gray, max_angle=15.0, margin=0.01, min_angle=0.5):
+    """Affine matrix taking page pixels into the upright crop, with the crop's
+    box (x, y, w, h) and skew; None when there is nothing to crop
+    """
+    height, width = gray.shape[:2]
+    rect = _document_bounds(gray)
+    if rect is None:
+        return None
+    
+    # Same angle convention as _estimate_skew
+    angle = rect[2]
+    if rect[1][0] < rect[1][1]:
+        angle -= 90
+    if angle < -45:
+        angle += 90
+    elif angle > 45:
+        angle -= 90
+    if abs(angle) > max_angle or abs(angle) < min_angle:
+        angle = 0.0
+    
+    pad = max(8, int(margin * max(width, height)))
+    matrix = cv2.getRotationMatrix2D(rect[0], angle, 1.0)
+    corners = cv2.transform(cv2.boxPoints(rect)[np.newaxis], matrix)[0]
+    x0, y0 = np.floor(corners.min(axis=0)).astype(int) - pad
+    x1, y1 = np.ceil(corners.max(axis=0)).astype(int) + pad
+    if not angle:
+        matrix = np.float64([[1, 0, 0], [0, 1, 0]])
+        x0, y0, x1, y1 = max(x0, 0), max(y0, 0), min(x1, width), min(y1, height)
+    matrix[:, 2] -= (x0, y0)
+    return matrix, (int(x0), int(y0), int(x1 - x0), int(y1 - y0)), float(angle)
+
+def _crop_document(image, max_angle=15.0, margin=0.01, min_angle=0.5):
+    """Tight, upright copy of the document on the bed, with its box and skew
+    
+    Crop and rotation happen in one warp over the output pixels only; pages
+    that are already straight are cropped with a plain slice.
+    """
+    height, width = image.shape[:2]
+    gray = cv2.cvtColor(image, cv2.COLOR_BGR2GRAY) if image.ndim == 3 else image
+    transform = _crop_transform(gray, max_angle, margin, min_angle)
+    if transform is None:
+        return image, (0, 0, width, height), 0.0
+    
+    matrix, (x, y, w, h), angle = transform
+    if not angle:
+        return image[y:y + h, x:x + w], (x, y, w, h), 0.0
+    
+    border = (255,) * (image.shape[2] if image.ndim == 3 else 1)
+    cropped = cv2.warpAffine(image, matrix, (w, h), flags=cv2.INTER_LINEAR, borderValue=border)
+    return cropped, (x, y, w, h), angle
+
+def _ink_kept(gray, max_angle=15.0):
+    """Fraction of the page's dark pixels that land inside its crop, at full resolution"""
+    ink = cv2.findNonZero((gray < 200).astype(np.uint8))
+    transform = _crop_transform(gray, max_angle)
+    if ink is None or transform is None:
+        return 1.0
+    
+    matrix, (_, _, w, h), _ = transform
+    points = cv2.transform(ink.reshape(-1, 1, 2).astype(np.float32), matrix).reshape(-1, 2)
+    inside = (points[:, 0] >= 0) & (points[:, 0] < w) & (points[:, 1] >= 0) & (points[:, 1] < h)
+    return float(np.count_nonzero(inside)) / len(points)
+
+def crop_statistics(config=None, bed_angle=3.0):
+    """Pixels the crop-and-deskew stage removes from each sample image, and
+    whether it kept all of the document's ink
+    
+    Every sample is measured as provided and placed, tilted by bed_angle,
+    on a blank bed-shaped page at half the bed width, which is how a lab
+    slip or ECG strip arrives from the scanner. ink_kept is the share of the
+    page's dark pixels that fall inside the crop; samples that lose any are
+    listed as lost_ink. Saves results/crop_statistics.json.
+    """
+    config = config or CONFIG
+    bed_width, bed_height = config["max_scan_size"]
+    rows = []
+    for doc_type, path in _iter_sample_images(config["sample_images_path"]):
+        image = cv2.imread(path)
+        if image is None:
+            continue
+        
+        bed_w = 2 * image.shape[1]
+        bed = np.full((int(bed_w * bed_height / bed_width), bed_w, 3), 255, np.uint8)
+        pad = image.shape[1] // 10
+        tilted = _rotate_image(cv2.copyMakeBorder(image, pad, pad, pad, pad, cv2.BORDER_CONSTANT,
+                                                  value=(255, 255, 255)), bed_angle)
+        h, w = tilted.shape[:2]
+        if h > bed.shape[0]:
+            continue
+        bed[(bed.shape[0] - h) // 3:(bed.shape[0] - h) // 3 + h, w // 4:w // 4 + w] = tilted
+        
+        row = {"document_type": doc_type, "file": os.path.basename(path)}
+        for name, page in (("as_scanned", image), ("on_bed", bed)):
+            start = time.time()
+            cropped, _, angle = _crop_document(page, config["crop_max_skew"])
+            elapsed = time.time() - start
+            row[name] = {
+                "pixels": page.shape[0] * page.shape[1],
+                "cropped_pixels": cropped.shape[0] * cropped.shape[1],
+                "saved": round(1 - cropped.shape[0] * cropped.shape[1] / (page.shape[0] * page.shape[1]), 3),
+                "ink_kept": round(_ink_kept(cv2.cvtColor(page, cv2.COLOR_BGR2GRAY), config["crop_max_skew"]), 4),
+                "skew": round(angle, 2),
+                "ms": round(elapsed * 1000, 1)
+            }
+        rows.append(row)
+        logger.info(f"{row['file']}: saved {row['as_scanned']['saved']:.0%} as scanned, "
+                    f"{row['on_bed']['saved']:.0%} on the bed (skew {row['on_bed']['skew']}), "
+                    f"ink kept {row['as_scanned']['ink_kept']:.1%} / {row['on_bed']['ink_kept']:.1%}")
+    
+    summary = {
+        name: {
+            "mean_saved": round(statistics.mean(r[name]["saved"] for r in rows), 3),
+            "min_ink_kept": min(r[name]["ink_kept"] for r in rows),
+            "lost_ink": [r["file"] for r in rows if r[name]["ink_kept"] < 1],
+            "mean_ms": round(statistics.mean(r[name]["ms"] for r in rows), 1)
+        } for name in ("as_scanned", "on_bed")
+    } if rows else {}
+    logger.info(f"Crop statistics: {summary}")
+    _save_report(config, "crop_statistics", {"summary": summary, "samples": rows}, "Crop statistics")
+    return summary
+
+class DocumentTypeClassifier(torch.nn.Module):
+    """Small CNN telling the document type from the page layout alone
+    
+    Film prints, ECG grids and typed lab reports already look different at
+    128x128, so a page is classified in tens of milliseconds without OCR.
+    """
+    input_size = 128
+    
+    def __init__(self, classes):
+        super().__init__()
+        self.classes = list(classes)
+        layers, channels = [], 1
+        for width in (16, 32, 64, 96):
+            layers += [
+                torch.nn.Conv2d(channels, width, 3, padding=1, bias=False),
+                torch.nn.BatchNorm2d(width),
+                torch.nn.ReLU(inplace=True),
+                torch.nn.MaxPool2d(2)
+            ]
+            channels = width
+        self.features = torch.nn.Sequential(*layers)
+        self.head = torch.nn.Linear(channels, len(self.classes))
+    
+    def forward(self, x):
+        return self.head(self.features(x).mean(dim=(2, 3)))
+    
+    @classmethod
+    def prepare(cls, image):
+        """Gray input plane for one page, strided before resizing so full scans stay cheap"""
+        step = max(1, max(image.shape[:2]) // (4 * cls.input_size))
+        small = image[::step, ::step]
+        if small.ndim == 3:
+            small = cv2.cvtColor(small, cv2.COLOR_BGR2GRAY)
+        small = cv2.resize(small, (cls.input_size, cls.input_size), interpolation=cv2.INTER_AREA)
+        return small.astype(np.float32) / 255.0 - 0.5
+    
+    def predict(self, image):
+        """(document type, confidence) for one page"""
+        with torch.no_grad():
+            probs = torch.softmax(self(torch.from_numpy(self.prepare(image))[None, None]), dim=1)[0]
+        index = int(probs.argmax())
+        return self.classes[index], float(probs[index])
+    
+    def save(self, path):
+        os.makedirs(os.path.dirname(path) or ".", exist_ok=True)
+        torch.save({"classes": self.classes, "state_dict": self.state_dict()}, path)
+    
+    @classmethod
+    def load(cls, path):
+        checkpoint = torch.load(path, map_location="cpu")
+        model = cls(checkpoint["classes"])
+        model.load_state_dict(checkpoint["state_dict"])
+        return model.eval()
+
+def _load_sample_pages(sample_path):
+    """(document type, path, gray page at twice the classifier input) for every sample image"""
+    size = 2 * DocumentTypeClassifier.input_size
+    pages = []
+    for doc_type, path in _iter_sample_images(sample_path):
+        image = cv2.imread(path, cv2.IMREAD_GRAYSCALE)
+        if image is not None:
+            pages.append((doc_type, path, cv2.resize(image, (size, size), interpolation=cv2.INTER_AREA)))
+    return pages
+
+def _augment_page(page, rng):
+    """Scanner-like variation of a gray sample page: tilt, offset, zoom, exposure and focus"""
+    h, w = page.shape
+    center = (w / 2 + rng.uniform(-0.05, 0.05) * w, h / 2 + rng.uniform(-0.05, 0.05) * h)
+    matrix = cv2.getRotationMatrix2D(center, rng.uniform(-8, 8), rng.uniform(0.9, 1.15))
+    page = cv2.warpAffine(page, matrix, (w, h), flags=cv2.INTER_LINEAR, borderMode=cv2.BORDER_REPLICATE)
+    page = page.astype(np.float32) * rng.uniform(0.8, 1.2) + rng.uniform(-25, 25)
+    if rng.random() < 0.3:
+        page = cv2.GaussianBlur(page, (3, 3), 0)
+    return np.clip(page, 0, 255).astype(np.uint8)
+
+def _train_type_classifier(pages, epochs=40, copies=4, batch_size=32, seed=0):
+    """Fit a DocumentTypeClassifier on (document type, gray page) pairs
+    
+    The sample corpus is a few dozen pages, so every epoch sees copies fresh
+    augmentations of each page rather than the pages themselves.
+    """
+    rng = np.random.default_rng(seed)
+    torch.manual_seed(seed)
+    classes = [doc_type for doc_type in SAMPLE_FOLDER_TYPES.values() if any(t == doc_type for t, _ in pages)]
+    labels = np.array([classes.index(doc_type) for doc_type, _ in pages] * copies)
+    model = DocumentTypeClassifier(classes)
+    optimizer = torch.optim.AdamW(model.parameters(), lr=3e-3, weight_decay=1e-3)
+    steps = epochs * -(-len(labels) // batch_size)
+    scheduler = torch.optim.lr_scheduler.OneCycleLR(optimizer, max_lr=3e-3, total_steps=steps)
+    
+    model.train()
+    for _ in range(epochs):
+        inputs = np.stack([
+            DocumentTypeClassifier.prepare(_augment_page(page, rng)) for _ in range(copies) for _, page in pages
+        ])[:, None]
+        order = rng.permutation(len(labels))
+        for start in range(0, len(order), batch_size):
+            batch = order[start:start + batch_size]
+            loss = torch.nn.functional.cross_entropy(
+                model(torch.from_numpy(inputs[batch])), torch.from_numpy(labels[batch]), label_smoothing=0.05)
+            optimizer.zero_grad()
+            loss.backward()
+            optimizer.step()
+            scheduler.step()
+    return model.eval()
+
+def train_type_classifier(config=None, epochs=40):
+    """Train the document type classifier on the sample corpus and save it to type_classifier_path"""
+    config = config or CONFIG
+    pages = _load_sample_pages(config["sample_images_path"])
+    if not pages:
+        raise RuntimeError(f"No sample images found in {config['sample_images_path']}")
+    
+    start = time.time()
+    model = _train_type_classifier([(doc_type, page) for doc_type, _, page in pages], epochs)
+    model.save(config["type_classifier_path"])
+    logger.info(f"Type classifier trained on {len(pages)} pages in {time.time() - start:.0f}s, "
+                f"saved to {config['type_classifier_path']}")
+    return model
+
+def type_detection_report(config=None, folds=4, epochs=40):
+    """Accuracy and latency of classifier, OCR keyword and combined document type detection
+    
+    Each sample is classified by a model trained without it (stratified
+    k-fold), so the accuracy is what an unseen page would get. "combined" is
+    what _detect_document_type does: the classifier, and OCR keywords only
+    below confidence_threshold. Saves results/type_detection_report.json.
+    """
+    config = config or CONFIG
+    system = MedicalImagingSystem.offline(config)
+    threshold = config["confidence_threshold"]
+    pages = _load_sample_pages(config["sample_images_path"])
+    seen = {}
+    fold_of = []
+    for doc_type, _, _ in pages:
+        fold_of.append(seen.get(doc_type, 0) % folds)
+        seen[doc_type] = seen.get(doc_type, 0) + 1
+    
+    rows = []
+    for fold in range(folds):
+        train = [(doc_type, page) for (doc_type, _, page), f in zip(pages, fold_of) if f != fold]
+        model = _train_type_classifier(train, epochs, seed=fold)
+        model.predict(pages[0][2])  # first pass includes one-off setup
+        
+        for (doc_type, path, _), f in zip(pages, fold_of):
+            if f != fold:
+                continue
+            image = cv2.imread(path)
+            start = time.time()
+            predicted, confidence = model.predict(image)
+            classifier_ms = (time.time() - start) * 1000
+            start = time.time()
+            ocr_text = system._ocr_image(image).text
+            ocr_type = system._match_document_type(ocr_text.lower()) or "text_report"
+            ocr_ms = (time.time() - start) * 1000
+            
+            confident = confidence >= threshold
+            rows.append({
+                "file": os.path.basename(path),
+                "document_type": doc_type,
+                "classifier": {"type": predicted, "confidence": round(confidence, 3), "ms": round(classifier_ms, 1)},
+                "ocr": {"type": ocr_type, "ms": round(ocr_ms, 1)},
+                "combined": {
+                    "type": predicted if confident else ocr_type,
+                    "ms": round(classifier_ms + (0 if confident else ocr_ms), 1),
+                    "used_ocr": not confident
+                }
+            })
+        logger.info(f"Fold {fold + 1}/{folds} done")
+    
+    summary = {
+        method: {
+            "accuracy": round(statistics.mean(r[method]["type"] == r["document_type"] for r in rows), 3),
+            "mean_ms": round(statistics.mean(r[method]["ms"] for r in rows), 1),
+            "median_ms": round(statistics.median(r[method]["ms"] for r in rows), 1)
+        } for method in ("classifier", "ocr", "combined")
+    } if rows else {}
+    if rows:
+        summary["combined"]["ocr_rate"] = round(statistics.mean(r["combined"]["used_ocr"] for r in rows), 3)
+        for method, stats in summary.items():
+            logger.info(f"{method:<10} accuracy {stats['accuracy'] * 100:5.1f}%  "
+                        f"mean {stats['mean_ms']:8.1f} ms  median {stats['median_ms']:8.1f} ms")
+    
+    _save_report(config, "type_detection_report",
+                 {"confidence_threshold": threshold, "summary": summary, "samples": rows}, "Type detection report")
+    return summary
+
+def roi_ocr_report(config=None):
+    """Latency and accuracy of header/footer band type detection against full-page OCR
+    
+    Runs both on every sample image and saves results/roi_ocr_report.json,
+    including which band decided each page.
+    """
+    config = config or CONFIG
+    system = MedicalImagingSystem.offline(config)
+    rows = []
+    for doc_type, path in _iter_sample_images(config["sample_images_path"]):
+        image = cv2.imread(path)
+        if image is None:
+            continue
+        
+        start = time.time()
+        page_type = system._match_document_type(system._ocr_image(image).text.lower()) or "text_report"
+        page_ms = (time.time() - start) * 1000
+        start = time.time()
+        roi_type, band = system._detect_type_from_bands(ScanBuffer(image, path))
+        roi_ms = (time.time() - start) * 1000
+        
+        rows.append({
+            "file": os.path.basename(path),
+            "document_type": doc_type,
+            "full_page": {"type": page_type, "ms": round(page_ms, 1)},
+            "bands": {"type": roi_type or "text_report", "ms": round(roi_ms, 1), "decided_by": band}
+        })
+        logger.info(f"{rows[-1]['file']}: full page {page_ms:.0f} ms, bands {roi_ms:.0f} ms ({band})")
+    
+    summary = {}
+    if rows:
+        for method in ("full_page", "bands"):
+            summary[method] = {
+                "accuracy": round(statistics.mean(r[method]["type"] == r["document_type"] for r in rows), 3),
+                "mean_ms": round(statistics.mean(r[method]["ms"] for r in rows), 1)
+            }
+        summary["agreement"] = round(statistics.mean(r["full_page"]["type"] == r["bands"]["type"] for r in rows), 3)
+        summary["saved"] = round(1 - summary["bands"]["mean_ms"] / summary["full_page"]["mean_ms"], 3)
+        summary["decided_by"] = {
+            band: sum(r["bands"]["decided_by"] == band for r in rows) for band in ("header", "footer", "page")}
+    
+    logger.info(f"Band OCR: {summary}")
+    _save_report(config, "roi_ocr_report", {"summary": summary, "samples": rows}, "Band OCR report")
+    return summary
+
+def ocr_scaling_report(config=None, workers=(1, 2, 4, 8)):
+    """Full-page OCR latency by number of tiles read concurrently
+    
+    Times every sample lab report at each worker count and checks how many
+    of the single-pass words the tiled result reproduces. Saves
+    results/ocr_scaling_report.json.
+    """
+    config = config or CONFIG
+    pages = [path for doc_type, path in _iter_sample_images(config["sample_images_path"]) if doc_type == "text_report"]
+    report = {}
+    baseline = {}
+    for count in workers:
+        system = MedicalImagingSystem.offline(dict(config, ocr_workers=count))
+        timings, recall = [], []
+        for path in pages:
+            image = cv2.imread(path)
+            start = time.time()
+            words = [word.text for word in system._ocr_image(image).words]
+            timings.append(time.time() - start)
+            if path not in baseline:
+                baseline[path] = words
+            reference = Counter(baseline[path])
+            recall.append(sum((reference & Counter(words)).values()) / max(1, sum(reference.values())))
+        system.ocr_executor.shutdown()
+        
+        report[count] = {"mean_ms": round(statistics.mean(timings) * 1000, 1), "word_recall": round(statistics.mean(recall), 3)}
+        report[count]["speedup"] = round(report[workers[0]]["mean_ms"] / report[count]["mean_ms"], 2)
+        logger.info(f"{count} OCR workers: {report[count]['mean_ms']:.0f} ms/page, "
+                    f"{report[count]['speedup']:.2f}x, word recall {report[count]['word_recall'] * 100:.1f}%")
+    
+    _save_report(config, "ocr_scaling_report", {"pages": len(pages), "workers": report}, "OCR scaling report")
+    return report
+
+def _classify_preview(image):
+    """Rough document class of a low-resolution preview scan
+    
+    The document is judged within its extent on the bed, so a slip or film
+    print lying on the glass is classified like one filling the page. Film
+    prints are mostly continuous tone. ECG paper is recognised by its grid:
+    either thin red lines (solid red areas such as coloured table headers
+    don't count), or faint lines crossing most of the document in both
+    directions, which also catches grey and pale pink grids. Everything else
+    is treated as a printed report. Measured on the samples by
+    preview_statistics.
+    """
+    gray = cv2.cvtColor(image, cv2.COLOR_BGR2GRAY) if image.ndim == 3 else image
+    ys, xs = np.nonzero(gray < 235)
+    if not len(xs):
+        return "text_report"
+    extent = (slice(ys.min(), ys.max() + 1), slice(xs.min(), xs.max() + 1))
+    paper = gray[extent]
+    if np.mean(paper < 200) > 0.35:
+        return "film"
+    
+    if image.ndim == 3:
+        hsv = cv2.cvtColor(image[extent], cv2.COLOR_BGR2HSV)
+        hue, saturation, value = hsv[..., 0], hsv[..., 1], hsv[..., 2]
+        red = (((hue < 12) | (hue > 160)) & (saturation > 40) & (value > 100)).astype(np.uint8)
+        thin_red = red > cv2.morphologyEx(red, cv2.MORPH_OPEN, np.ones((5, 5), np.uint8))
+        if np.mean(thin_red) > 0.02:
+            return "ecg"
+    
+    # Text and table rules rarely cover half the document; a grid gives dozens of such lines each way
+    lines = (paper < np.median(paper) - 10).astype(np.int8)
+    columns, rows = (lines.mean(axis=0) > 0.5).astype(np.int8), (lines.mean(axis=1) > 0.5).astype(np.int8)
+    if min(np.sum(np.diff(columns) == 1), np.sum(np.diff(rows) == 1)) >= 9:
+        return "ecg"
+    return "text_report"
+
+def preview_statistics(config=None):
+    """Preview classification accuracy and scanned bytes on the sample images
+    
+    Each sample is previewed twice: as a page the width of the bed, and as a
+    slip half that wide lying on an empty bed. Both are reduced to the
+    preview resolution and classified. Bytes are the preview plus the pass
+    with the predicted class's profile, against one pass with the default
+    profile. Saves results/preview_statistics.json.
+    """
+    config = config or CONFIG
+    system = MedicalImagingSystem.offline(config)
+    preview_profile = system._scan_profile("preview")
+    resolution = preview_profile["resolution"]
+    bed_width, bed_height = (int(side * resolution) for side in config["max_scan_size"])
+    expected_class = {"text_report": "text_report", "ecg": "ecg"}
+    
+    rows = []
+    for doc_type, path in _iter_sample_images(config["sample_images_path"]):
+        image = cv2.imread(path)
+        if image is None:
+            continue
+        
+        page = cv2.resize(image, None, fx=bed_width / image.shape[1], fy=bed_width / image.shape[1],
+                          interpolation=cv2.INTER_AREA)
+        slip = cv2.resize(page, None, fx=0.5, fy=0.5, interpolation=cv2.INTER_AREA)
+        bed = np.full((bed_height, bed_width, 3), 255, np.uint8)
+        if slip.shape[0] > bed_height - bed_width // 8:
+            continue
+        bed[bed_width // 8:bed_width // 8 + slip.shape[0], bed_width // 8:bed_width // 8 + slip.shape[1]] = slip
+        
+        row = {"file": os.path.basename(path), "expected": expected_class.get(doc_type, "film")}
+        for name, preview in (("page", page), ("on_bed", bed)):
+            predicted = _classify_preview(preview)
+            row[name] = {
+                "predicted": predicted,
+                "bytes": (system._scan_bytes(preview_profile, preview.shape, resolution) +
+                          system._scan_bytes(system._scan_profile(predicted), preview.shape, resolution)),
+                "baseline_bytes": system._scan_bytes(system._scan_profile("default"), preview.shape, resolution)
+            }
+        rows.append(row)
+    
+    summary = {}
+    for doc_class in sorted({row["expected"] for row in rows}):
+        entries = [row for row in rows if row["expected"] == doc_class]
+        summary[doc_class] = {"samples": len(entries)}
+        for name in ("page", "on_bed"):
+            summary[doc_class][name] = {
+                "accuracy": round(statistics.mean(row[name]["predicted"] == doc_class for row in entries), 3),
+                "misclassified": [f"{row['file']} as {row[name]['predicted']}"
+                                  for row in entries if row[name]["predicted"] != doc_class],
+                "bytes_saved": round(1 - sum(row[name]["bytes"] for row in entries) /
+                                     sum(row[name]["baseline_bytes"] for row in entries), 3)
+            }
+        logger.info(f"{doc_class}: {summary[doc_class]}")
+    
+    _save_report(config, "preview_statistics", {"summary": summary, "samples": rows}, "Preview statistics")
+    return summary
+
+def summarize_scan_stats(config=None):
+    """Average scan time and bytes per document class from adaptive scans
+    
+    Preview and scan bytes are for the page size actually received. The
+    baseline is the same page in a single pass with the default profile,
+    so the saving from the preview pass is visible per class.
+    """
+    config = config or CONFIG
+    stats_path = f"{config['output_path']}/scan_stats.jsonl"
+    if not os.path.exists(stats_path):
+        logger.warning(f"No scan statistics at {stats_path}")
+        return {}
+    
+    by_class = {}
+    with open(stats_path) as f:
+        for line in f:
+            if line.strip():
+                entry = json.loads(line)
+                by_class.setdefault(entry["document_class"], []).append(entry)
+    
+    summary = {}
+    for doc_class, entries in sorted(by_class.items()):
+        summary[doc_class] = {
+            "scans": len(entries),
+            "mean_scan_s": round(statistics.mean(e["preview_s"] + e["scan_s"] for e in entries), 3),
+            "mean_preview_s": round(statistics.mean(e["preview_s"] for e in entries), 3),
+            "mean_mb": round(statistics.mean(e["preview_bytes"] + e["scan_bytes"] for e in entries) / 2**20, 2),
+            "baseline_mb": round(statistics.mean(e["baseline_bytes"] for e in entries) / 2**20, 2)
+        }
+        logger.info(f"{doc_class}: {summary[doc_class]}")
+    return summary
+
+# Modality keywords in the order they decide the document type when several appear
+MODALITY_KEYWORDS = OrderedDict([
+    ("xray", ("x-ray", "radiograph")),
+    ("mri", ("mri", "magnetic resonance")),
+    ("ct", ("ct scan", "computed tomography")),
+    ("ecg", ("ecg", "electrocardiogram")),
+    ("ultrasound", ("ultrasound", "sonograph"))
+])
+
+KeywordMatch = namedtuple("KeywordMatch", "start end keyword kind value")
+
+class KeywordMatcher:
+    """Aho-Corasick automaton finding every keyword in one pass over a text
+    
+    Built once from (keyword, kind, value, whole_word) entries. Matching is
+    case-insensitive and takes time proportional to the text length plus
+    the matches, however many keywords there are. whole_word entries only
+    match between non-alphanumeric characters. Positions index the
+    lowercased text.
+    """
+    def __init__(self, entries):
+        self.transitions = [{}]
+        self.outputs = [[]]
+        for keyword, kind, value, whole_word in entries:
+            keyword = keyword.lower()
+            if not keyword:
+                continue
+            state = 0
+            for char in keyword:
+                if char not in self.transitions[state]:
+                    self.transitions[state][char] = len(self.transitions)
+                    self.transitions.append({})
+                    self.outputs.append([])
+                state = self.transitions[state][char]
+            self.outputs[state].append((keyword, kind, value, whole_word))
+        
+        # Breadth first, so a state's failure target is complete before the state itself
+        self.fail = [0] * len(self.transitions)
+        queue = deque(self.transitions[0].values())
+        while queue:
+            state = queue.popleft()
+            for char, child in self.transitions[state].items():
+                queue.append(child)
+                target = self.fail[state]
+                while target and char not in self.transitions[target]:
+                    target = self.fail[target]
+                self.fail[child] = self.transitions[target].get(char, 0)
+                self.outputs[child] = self.outputs[child] + self.outputs[self.fail[child]]
+    
+    def find_all(self, text):
+        """KeywordMatches for every keyword occurrence in text, by end position"""
+        text = text.lower()
+        transitions, fail, outputs = self.transitions, self.fail, self.outputs
+        matches = []
+        state = 0
+        for end, char in enumerate(text, 1):
+            while state and char not in transitions[state]:
+                state = fail[state]
+            state = transitions[state].get(char, 0)
+            for keyword, kind, value, whole_word in outputs[state]:
+                start = end - len(keyword)
+                if whole_word and ((start > 0 and text[start - 1].isalnum()) or
+                                   (end < len(text) and text[end].isalnum())):
+                    continue
+                matches.append(KeywordMatch(start, end, keyword, kind, value))
+        return matches
+
+def build_keyword_matcher(medical_terms=()):
+    """One matcher for the modality keywords and the medical terminology terms"""
+    entries = [(keyword, "modality", doc_type, False)
+               for doc_type, keywords in MODALITY_KEYWORDS.items() for keyword in keywords]
+    entries += [(term, "term", term, True) for term in medical_terms]
+    return KeywordMatcher(entries)
+
+OcrWord = namedtuple("OcrWord", "text box confidence line")
+
+class OcrResult:
+    """Tesseract's reading of a page, produced once per scan and shared by
+    type detection, the analyzers and the API fallback
+    
+    `words` are OcrWords in reading order, with (x, y, w, h) boxes in the
+    coordinates of the image that was read (a streaming scan's result is
+    read from the page as acquired, so its boxes are in that image's
+    coordinates, before cropping and deskewing) and Tesseract's 0-100
+    confidence. `text` has one line per text line Tesseract found.
+    """
+    def __init__(self, words, language):
+        self.words = words
+        self.language = language
+        self.confidence = statistics.mean(word.confidence for word in words) if words else 0.0
+        
+        lines, key = [], None
+        for word in words:
+            if word.line != key:
+                lines.append([])
+                key = word.line
+            lines[-1].append(word.text)
+        self.text = "\n".join(" ".join(line) for line in lines)
+    
+    @classmethod
+    def from_image(cls, image, language="eng", origin=(0, 0)):
+        """OCR an image, shifting the boxes by origin (x, y)"""
+        data = pytesseract.image_to_data(image, lang=language, output_type=pytesseract.Output.DICT)
+        words = []
+        for i, text in enumerate(data["text"]):
+            confidence = float(data["conf"][i])
+            if confidence < 0 or not text.strip():
+                continue
+            box = (data["left"][i] + origin[0], data["top"][i] + origin[1], data["width"][i], data["height"][i])
+            words.append(OcrWord(text, box, confidence, (data["block_num"][i], data["par_num"][i], data["line_num"][i])))
+        return cls(words, language)
+    
+    @classmethod
+    def from_tiles(cls, image, language, executor, tiles, overlap, origin=(0, 0)):
+        """OCR an image as horizontal tiles read concurrently on executor
+        
+        The tile cores split the rows evenly and each tile also reads overlap
+        rows past both core edges, so a line cut by an edge is read whole;
+        merge then keeps every word from the tile whose core holds its centre.
+        """
+        height = image.shape[0]
+        cores = [height * i // tiles for i in range(tiles + 1)]
+        regions = [(max(0, cores[i] - overlap), min(height, cores[i + 1] + overlap)) for i in range(tiles)]
+        futures = [executor.submit(cls.from_image, image[top:bottom], language, (origin[0], origin[1] + top))
+                   for top, bottom in regions]
+        return cls.merge([(future.result(), origin[1] + top, origin[1] + bottom)
+                          for future, (top, bottom) in zip(futures, regions)])
+    
+    @classmethod
+    def merge(cls, parts):
+        """Join the results of overlapping horizontal strips of one page
+        
+        parts are (result, top, bottom) in page rows, top to bottom. A word
+        read in two strips is kept from the strip on its side of the middle
+        of the overlap.
+        """
+        words = []
+        for n, (part, top, bottom) in enumerate(parts):
+            upper = (top + parts[n - 1][2]) / 2 if n > 0 else float("-inf")
+            lower = (parts[n + 1][1] + bottom) / 2 if n + 1 < len(parts) else float("inf")
+            for word in part.words:
+                if upper <= word.box[1] + word.box[3] / 2 < lower:
+                    words.append(word._replace(line=(n,) + word.line))
+        return cls(words, parts[0][0].language if parts else "")
+
+class ScanBuffer:
+    """A scanned page kept decoded in memory from acquisition through analysis
+    
+    Analyzers read `image` (BGR, treat as read-only) instead of decoding the
+    file again; `hints` carries whatever acquisition already worked out.
+    The archival PNG is written in the background, and code that still needs
+    a file can pass the buffer wherever a path is accepted: __fspath__ waits
+    for that write to finish.
+    """
+    def __init__(self, image, path, hints=None, on_disk=False):
+        self.image = image
+        self.path = path
+        self.hints = hints or {}
+        self.on_disk = on_disk
+        self.archived = None  # Future of the background write
+    
+    @classmethod
+    def from_file(cls, path):
+        image = cv2.imread(path)
+        if image is None:
+            raise RuntimeError(f"Could not read scan {path}")
+        return cls(image, path, on_disk=True)
+    
+    def rgb(self):
+        code = cv2.COLOR_BGR2RGB if self.image.ndim == 3 else cv2.COLOR_GRAY2RGB
+        return cv2.cvtColor(self.image, code)
+    
+    def gray(self):
+        return cv2.cvtColor(self.image, cv2.COLOR_BGR2GRAY) if self.image.ndim == 3 else self.image
+    
+    def __fspath__(self):
+        if self.archived is not None:
+            self.archived.result()
+        return self.path
+    
+    def __str__(self):
+        return self.path
+
+class ReplayScannerDevice:
+    """Scanner stand-in that replays the sample images, for development and load tests
+    
+    Each scan waits replay_latency_s before the first row and then delivers
+    pixels at replay_mb_per_s, cycling through the sample corpus in order.
+    Samples count as scanned at scan_resolution and are resized for others.
+    A pass with the preview profile sees the same page as the scan after it.
+    """
+    def __init__(self, config):
+        self.config = config
+        self.samples = [path for _, path in _iter_sample_images(config["sample_images_path"])]
+        if not self.samples:
+            raise RuntimeError(f"No sample images found in {config['sample_images_path']}")
+        self.resolution = config["scan_resolution"]
+        self.color_mode = "color"
+        self.bit_depth = 8
+        self.scans = 0
+        self._lock = threading.Lock()
+    
+    def get_device_info(self):
+        return f"Replay of {len(self.samples)} sample images"
+    
+    def set_resolution(self, resolution):
+        self.resolution = resolution
+    
+    def set_color_mode(self, color_mode):
+        self.color_mode = color_mode
+    
+    def set_bit_depth(self, bit_depth):
+        self.bit_depth = bit_depth
+    
+    def set_document_size(self, size):
+        pass
+    
+    def _next_page(self):
+        with self._lock:
+            path = self.samples[self.scans % len(self.samples)]
+            if self.resolution != self.config["scan_profiles"]["preview"]["resolution"]:
+                self.scans += 1
+        
+        image = cv2.imread(path)
+        scale = self.resolution / self.config["scan_resolution"]
+        if scale != 1:
+            interpolation = cv2.INTER_AREA if scale < 1 else cv2.INTER_LINEAR
+            image = cv2.resize(image, None, fx=scale, fy=scale, interpolation=interpolation)
+        if self.color_mode != "color":
+            image = cv2.cvtColor(image, cv2.COLOR_BGR2GRAY)
+            if self.bit_depth == 1:
+                _, image = cv2.threshold(image, 0, 255, cv2.THRESH_BINARY | cv2.THRESH_OTSU)
+        return image
+    
+    def _transfer(self, nbytes):
+        time.sleep(nbytes / (self.config["replay_mb_per_s"] * 1024 * 1024))
+    
+    def scan_bands(self, band_height):
+        image = self._next_page()
+        time.sleep(self.config["replay_latency_s"])
+        for top in range(0, image.shape[0], band_height):
+            band = image[top:top + band_height]
+            self._transfer(band.nbytes)
+            yield band
+    
+    def scan_to_array(self):
+        image = self._next_page()
+        time.sleep(self.config["replay_latency_s"])
+        self._transfer(image.nbytes)
+        return image
+    
+    def scan(self, output_path):
+        return cv2.imwrite(output_path, self.scan_to_array())
+    
+    def scan_feeder(self):
+        for _ in range(self.config["replay_feeder_pages"]):
+            yield self.scan_to_array()
+
+class ReplayGPIO:
+    """Stand-in for RPi.GPIO that records LED output instead of driving pins"""
+    BCM, IN, OUT, PUD_UP, FALLING = "BCM", "IN", "OUT", "PUD_UP", "FALLING"
+    HIGH, LOW = 1, 0
+    
+    def __init__(self):
+        self.outputs = []  # (pin, value) in the order they were set
+    
+    def setmode(self, mode):
+        pass
+    
+    def setup(self, pin, direction, pull_up_down=None):
+        pass
+    
+    def add_event_detect(self, pin, edge, callback=None, bouncetime=None):
+        pass
+    
+    def output(self, pin, value):
+        self.outputs.append((pin, value))
+    
+    def input(self, pin):
+        return self.HIGH  # switches read as released
+    
+    def times_set(self, pin, value):
+        return sum(1 for output in self.outputs if output == (pin, value))
+    
+    def cleanup(self):
+        pass
+
+def run_replay_load(config=None, scans=50, interval_s=0.0, through="button"):
+    """Drive sustained load through the pipeline with the replay scanner and report throughput
+    
+    through="button" runs the whole kiosk flow, audio prompts included, via
+    _button_callback; "analyze" calls scan_document and analyze_document
+    directly. interval_s spaces out scan starts to model a patient arrival
+    rate. Saves results/replay_load.json. Needs the modality analyzers to
+    report anything but failures; this tree doesn't ship them yet.
+    """
+    config = dict(config or CONFIG, hardware_backend="replay")
+    system = MedicalImagingSystem(config)
+    
+    latencies, failures = [], 0
+    start = time.time()
+    for _ in range(scans):
+        scan_start = time.time()
+        if through == "button":
+            # The callback handles its own errors, the error LED tells whether it failed
+            errors = system.gpio.times_set(config["led_error_pin"], ReplayGPIO.HIGH)
+            system._button_callback(config["button_gpio_pin"])
+            failures += system.gpio.times_set(config["led_error_pin"], ReplayGPIO.HIGH) > errors
+        else:
+            try:
+                system.analyze_document(system.scan_document())
+            except Exception as e:
+                logger.error(f"Replayed scan failed: {str(e)}")
+                failures += 1
+        latencies.append(time.time() - scan_start)
+        
+        if interval_s:
+            time.sleep(max(0.0, interval_s - latencies[-1]))
+    elapsed = time.time() - start
+    
+    latencies.sort()
+    report = {
+        "through": through,
+        "scans": scans,
+        "failures": failures,
+        "elapsed_s": round(elapsed, 2),
+        "scans_per_minute": round(60 * scans / elapsed, 2),
+        "latency_mean_s": round(statistics.mean(latencies), 3),
+        "latency_p50_s": round(latencies[len(latencies) // 2], 3),
+        "latency_p95_s": round(latencies[min(len(latencies) - 1, int(len(latencies) * 0.95))], 3),
+        "replay_latency_s": config["replay_latency_s"],
+        "replay_mb_per_s": config["replay_mb_per_s"]
+    }
+    logger.info(f"Replay load test: {report}")
+    _save_report(config, "replay_load", report, "Replay load report")
+    return report
+
+class ForkServer:
+    """Keep models loaded in a long-lived parent and run the kiosk in forked workers
+    
+    In "per_crash" mode one worker owns the hardware and is re-forked whenever
+    it dies. In "per_job" mode the parent owns the hardware and forks a worker
+    per button press. Workers inherit models and translators copy-on-write,
+    so recovering from a crash skips the whole cold start. The parent never
+    runs inference, so per_job workers start cold and each scan pays the
+    models' first-inference latency.
+    """
+    def __init__(self, config=None):
+        self.config = config or CONFIG
+        self.system = MedicalImagingSystem(self.config)
+        self.worker_pid = None
+        self.workers_started = 0
+    
+    def serve_forever(self):
+        signal.signal(signal.SIGTERM, self._shutdown)
+        signal.signal(signal.SIGHUP, self._reload)
+        
+        if self.config["fork_server_mode"] == "per_job":
+            logger.info("Fork server ready, forking a worker per scan")
+            while True:
+                signal.pause()
+        
+        while True:
+            started = time.time()
+            self.workers_started += 1
+            self.worker_pid = os.fork()
+            if self.worker_pid == 0:
+                self._run_worker(first=self.workers_started == 1)
+            
+            logger.info(f"Started worker {self.worker_pid}")
+            _, status = os.waitpid(self.worker_pid, 0)
+            logger.error(
+                f"Worker {self.worker_pid} exited with code {os.waitstatus_to_exitcode(status)}, restarting")
+            
+            # Avoid a hot restart loop when the worker fails during its own startup
+            if time.time() - started < 5:
+                time.sleep(self.config["fork_server_restart_delay"])
+    
+    def _run_worker(self, first=True):
+        """Worker body: claim the hardware and serve button presses until death
+        
+        Only the first worker blinks the LEDs and warms up before taking scans.
+        A replacement after a crash is ready as soon as it holds the hardware
+        and warms each model with a single pass in the background.
+        """
+        signal.signal(signal.SIGTERM, signal.SIG_DFL)
+        signal.signal(signal.SIGHUP, self.system._on_reload_signal)
+        try:
+            self.system._reload_lock = threading.Lock()  # the parent may have been mid-reload when it forked
+            self.system._in_worker = True
+            self.system.ready.clear()
+            self.system._init_hardware(self_test=first)
+            self.system._init_audio_output()
+            if self.config["warmup_on_start"]:
+                if first:
+                    self.system._warm_up()
+                else:
+                    threading.Thread(target=self.system._warm_up, args=(1,), daemon=True).start()
+            self.system.ready.set()
+            logger.info(f"Worker {os.getpid()} ready")
+            while True:
+                signal.pause()
+        except Exception as e:
+            logger.error(f"Worker {os.getpid()} failed: {str(e)}")
+        finally:
+            for handler in logging.getLogger().handlers:
+                handler.flush()
+            os._exit(1)
+    
+    def _reload(self, signum, frame):
+        """Swap in new custom models here, for future workers, and in the running worker
+        
+        A forked worker has its own copy of the models, so the parent's swap
+        never reaches it; the worker reloads on its own. In per_job mode a
+        scan already in progress finishes with the previous version.
+        """
+        self.system._on_reload_signal(signum, frame)
+        if self.worker_pid:
+            try:
+                os.kill(self.worker_pid, signal.SIGHUP)
+            except ProcessLookupError:
+                pass  # the worker just died, its replacement forks from the reloaded parent
+    
+    def _shutdown(self, signum, frame):
+        if self.worker_pid:
+            os.kill(self.worker_pid, signal.SIGTERM)
+        sys.exit(0)
+
 class MedicalImagingSystem:
     def __init__(self, config=None):
         """Initialize the Medical Imaging Analysis System"""
         self.config = config or CONFIG
+        self.profiler = BootProfiler()
         logger.info("Initializing Medical Imaging Analysis System...")
         
+        # Scans are refused until initialization and warm-up have finished
+        self.ready = threading.Event()
+        self._in_worker = False
+        self.archive_executor = None
+        self.current_language = None  # set by the language switch, default_language until then
+        self.keyword_matcher = build_keyword_matcher()  # terminology is added once it has loaded
+        # Threads start on first submit, so fork server parents that never OCR fork cleanly
+        self.ocr_executor = ThreadPoolExecutor(max_workers=self.config["ocr_workers"], thread_name_prefix="ocr-tile")
+        fork_mode = self.config["fork_server_mode"]
+        
+        # SIGHUP (systemctl reload) picks up new model versions without a restart. Installed
+        # before anything loads so an early reload can't kill the process, and here because
+        # model loading may run on a startup pool thread, where signal handlers can't be set
+        self._reload_lock = threading.Lock()
+        if threading.current_thread() is threading.main_thread():
+            signal.signal(signal.SIGHUP, self._on_reload_signal)
+        
         # Create necessary directories
         os.makedirs(self.config["temp_path"], exist_ok=True)
         os.makedirs(self.config["output_path"], exist_ok=True)
         
-        # Initialize hardware components
-        self._init_hardware()
-        
-        # Load AI models
-        self._init_models()
+        # Initialize hardware components; per-crash fork server workers claim it themselves
+        if fork_mode != "per_crash":
+            self.profiler.run("hardware", self._init_hardware)
         
-        # Initialize language processing
-        self._init_language_processing()
+        # Load AI models and language processing, concurrently if enabled
+        self.load_times = {}
+        if self.config["parallel_startup"]:
+            self.profiler.run("models_and_language", self._init_models_and_language_parallel)
+        else:
+            self.startup_executor = None
+            self.profiler.run("models", self._init_models)
+            self.profiler.run("language", self._init_language_processing)
+        self._log_load_times()
         
         # Initialize audio system
-        self._init_audio_system()
+        self.profiler.run("audio", self._init_audio_system)
         
+        # Run synthetic inputs through loaded models so the first patient doesn't pay for it
+        # Fork server parents skip this: inference starts runtime thread pools that don't survive fork
+        self.warmup_stats = {}
+        if self.config["warmup_on_start"] and fork_mode == "off":
+            self.profiler.run("warmup", self._warm_up)
+        
+        self.ready.set()
         logger.info("System initialization complete")
+        self._write_boot_profile()
+    
+    @classmethod
+    def offline(cls, config=None):
+        """Create an instance with no hardware, models or audio, for offline tools"""
+        system = cls.__new__(cls)
+        system.config = config or CONFIG
+        system.profiler = BootProfiler()
+        system.load_times = {}
+        system.startup_executor = None
+        system.weight_pack = None
+        system.calibration = None
+        system.type_classifier = None
+        system.keyword_matcher = build_keyword_matcher()
+        system.ocr_executor = ThreadPoolExecutor(max_workers=system.config["ocr_workers"], thread_name_prefix="ocr-tile")
+        return system
+    
+    def _init_hardware(self, self_test=True):
+        """Initialize hardware components including scanner and GPIO
         
-    def _init_hardware(self):
-        """Initialize hardware components including scanner and GPIO"""
+        self_test blinks both LEDs; re-forked fork server workers skip it.
+        """
         logger.info("Initializing hardware components...")
         try:
             # Initialize scanner connection
-            self.scanner = ScannerDevice(self.config["scanner_device"])
-            logger.info(f"Scanner connected: {self.scanner.get_device_info()}")
+            with self.profiler.phase("scanner"):
+                if self.config["hardware_backend"] == "replay":
+                    self.scanner = ReplayScannerDevice(self.config)
+                else:
+                    self.scanner = ScannerDevice(self.config["scanner_device"])
+                
+                # The scanner session keeps its settings, later scans only change what differs
+                self.scanner_settings = {}
+                self._apply_scan_profile("default")
+                logger.info(f"Scanner connected: {self.scanner.get_device_info()}")
+                self.calibration = self._load_calibration()
             
             # Initialize GPIO for button and LEDs
-            import RPi.GPIO as GPIO
-            GPIO.setmode(GPIO.BCM)
-            GPIO.setup(self.config["button_gpio_pin"], GPIO.IN, pull_up_down=GPIO.PUD_UP)
-            GPIO.setup(self.config["led_status_pin"], GPIO.OUT)
-            GPIO.setup(self.config["led_error_pin"], GPIO.OUT)
-            
-            # Set up button callback
-            GPIO.add_event_detect(
-                self.config["button_gpio_pin"], 
-                GPIO.FALLING, 
-                callback=self._button_callback, 
-                bouncetime=300
-            )
+            with self.profiler.phase("gpio"):
+                if self.config["hardware_backend"] == "replay":
+                    self.gpio = ReplayGPIO()
+                else:
+                    import RPi.GPIO
+                    self.gpio = RPi.GPIO
+                GPIO = self.gpio
+                GPIO.setmode(GPIO.BCM)
+                GPIO.setup(self.config["button_gpio_pin"], GPIO.IN, pull_up_down=GPIO.PUD_UP)
+                GPIO.setup(self.config["led_status_pin"], GPIO.OUT)
+                GPIO.setup(self.config["led_error_pin"], GPIO.OUT)
+                for pin in self.config["scan_profile_switch_pins"].values():
+                    GPIO.setup(pin, GPIO.IN, pull_up_down=GPIO.PUD_UP)
+                
+                # Set up button callback
+                GPIO.add_event_detect(
+                    self.config["button_gpio_pin"], 
+                    GPIO.FALLING, 
+                    callback=self._button_callback, 
+                    bouncetime=300
+                )
             
             # Test LEDs
-            GPIO.output(self.config["led_status_pin"], GPIO.HIGH)
-            time.sleep(0.5)
-            GPIO.output(self.config["led_status_pin"], GPIO.LOW)
-            GPIO.output(self.config["led_error_pin"], GPIO.HIGH)
-            time.sleep(0.5)
-            GPIO.output(self.config["led_error_pin"], GPIO.LOW)
+            if self_test:
+                with self.profiler.phase("led_self_test"):
+                    GPIO.output(self.config["led_status_pin"], GPIO.HIGH)
+                    time.sleep(0.5)
+                    GPIO.output(self.config["led_status_pin"], GPIO.LOW)
+                    GPIO.output(self.config["led_error_pin"], GPIO.HIGH)
+                    time.sleep(0.5)
+                    GPIO.output(self.config["led_error_pin"], GPIO.LOW)
             
             self.hardware_ready = True
             logger.info("Hardware initialization successful")
@@ -140,41 +2186,109 @@ class MedicalImagingSystem:
             logger.error(f"Hardware initialization failed: {str(e)}")
             raise RuntimeError(f"Failed to initialize hardware: {str(e)}")
     
+    def _init_models_and_language_parallel(self):
+        """Run model and language loading side by side on a shared artifact pool"""
+        self.startup_executor = ThreadPoolExecutor(
+            max_workers=self.config["startup_workers"],
+            thread_name_prefix="startup"
+        )
+        start = time.time()
+        try:
+            # Each phase blocks on its own artifacts, so phases get a separate pool
+            with ThreadPoolExecutor(max_workers=2) as phases:
+                futures = [
+                    phases.submit(self.profiler.run, "models", self._init_models),
+                    phases.submit(self.profiler.run, "language", self._init_language_processing)
+                ]
+            for future in futures:
+                future.result()
+            logger.info(f"Parallel model and language loading took {time.time() - start:.1f}s")
+        finally:
+            self.startup_executor.shutdown()
+            self.startup_executor = None
+    
+    def _load_artifacts(self, loaders):
+        """Run named loader callables, concurrently while the startup pool is alive"""
+        if self.startup_executor is None:
+            return {name: loader() for name, loader in loaders.items()}
+        
+        futures = {name: self.startup_executor.submit(loader) for name, loader in loaders.items()}
+        return {name: future.result() for name, future in futures.items()}
+    
+    def _timed_load(self, name, loader, *args, **kwargs):
+        """Load a single artifact and record how long it took"""
+        start = time.time()
+        with self.profiler.phase(f"load.{name}", absolute=True):
+            artifact = loader(*args, **kwargs)
+        self.load_times[name] = time.time() - start
+        logger.info(f"Loaded {name} in {self.load_times[name]:.2f}s")
+        return artifact
+    
+    def _write_boot_profile(self):
+        """Save this boot's phase timings for comparison across releases"""
+        try:
+            self.profiler.write(
+                _boot_profile_path(),
+                config={key: self.config[key] for key in (
+                    "parallel_startup", "lazy_model_loading", "use_weight_pack",
+                    "inference_backend", "fork_server_mode", "warmup_on_start")},
+                warmup=self.warmup_stats
+            )
+        except OSError as e:
+            logger.warning(f"Could not write boot profile: {str(e)}")
+    
+    def _log_load_times(self):
+        """Report per-artifact load times, slowest first"""
+        if not self.load_times:
+            return
+        
+        logger.info("Artifact load times:")
+        for name, seconds in sorted(self.load_times.items(), key=lambda item: -item[1]):
+            logger.info(f"  {name:<40} {seconds:7.2f}s")
+        logger.info(f"  {'total (serial sum)':<40} {sum(self.load_times.values()):7.2f}s")
+    
     def _init_models(self):
         """Initialize AI models for different imaging types"""
         logger.info("Loading AI models...")
         
+        # Document type detection runs locally even in API-only mode
+        self.type_classifier = self._load_type_classifier()
+        
+        self.model_manager = None
         if not self.config["use_local_models"]:
             logger.info("Using API-only mode, skipping local model loading")
             return
         
+        # OCR for text reports
+        self.ocr_lang_map = {
+            "english": "eng",
+            "tamil": "tam",
+            "malayalam": "mal"
+        }
+        
+        # Map all packed weights once; loaders below build models on top of it
+        self.weight_pack = None
+        if self.config["use_weight_pack"] and os.path.exists(self.config["weight_pack_path"]):
+            self.weight_pack = WeightPack(self.config["weight_pack_path"])
+            logger.info(f"Using weight pack {self.config['weight_pack_path']}")
+        
+        models_path = self.config["models_path"]
+        self.model_manager = ModelManager(self, self.config["model_weight_budget_mb"])
+        self.model_manager.register("xray", self._load_xray_model)
+        self.model_manager.register("mri", self._load_mri_model, _path_nbytes(f"{models_path}/mri_model.pth"))
+        self.model_manager.register("ct", self._load_ct_model, _path_nbytes(f"{models_path}/ct_model"))
+        self.model_manager.register("ecg", self._load_ecg_model, _path_nbytes(f"{models_path}/ecg_model"))
+        self.model_manager.register("text_report", self._load_report_model, _path_nbytes(
+            self._onnx_model_path("text_report")) if self._uses_onnx("text_report") else 0)
+        self._register_custom_models()
+        
+        # Forked workers would each load and then discard lazily loaded models
+        if self.config["lazy_model_loading"] and self.config["fork_server_mode"] == "off":
+            logger.info("Lazy model loading enabled, models will load on first use")
+            return
+        
         try:
-            # X-Ray analysis model
-            self.xray_processor = ViTImageProcessor.from_pretrained("medical-ai/xray-vit-base")
-            self.xray_model = AutoModelForImageClassification.from_pretrained("medical-ai/xray-vit-base")
-            
-            # MRI analysis model
-            self.mri_model = torch.hub.load('pytorch/vision:v0.10.0', 'resnet50', pretrained=True)
-            self.mri_model.load_state_dict(torch.load(f"{self.config['models_path']}/mri_model.pth"))
-            self.mri_model.eval()
-            
-            # CT scan analysis model
-            self.ct_model = tf.keras.models.load_model(f"{self.config['models_path']}/ct_model")
-            
-            # ECG analysis model
-            self.ecg_model = tf.keras.models.load_model(f"{self.config['models_path']}/ecg_model")
-            
-            # OCR for text reports
-            self.ocr_lang_map = {
-                "english": "eng",
-                "tamil": "tam",
-                "malayalam": "mal"
-            }
-            
-            # General medical report analyzer
-            self.report_tokenizer = AutoTokenizer.from_pretrained("medical-ai/medrpt-bert-base")
-            self.report_model = AutoModelForSeq2SeqLM.from_pretrained("medical-ai/medrpt-bert-base")
-            
+            self.model_manager.load_all(self._load_artifacts)
             logger.info("AI models loaded successfully")
         except Exception as e:
             logger.error(f"Failed to load AI models: {str(e)}")
@@ -183,6 +2297,344 @@ class MedicalImagingSystem:
             else:
                 logger.warning("Will use API fallback for analysis")
     
+    def _load_type_classifier(self):
+        """The document type classifier, None when disabled or not trained yet"""
+        path = self.config["type_classifier_path"]
+        if not self.config["type_classifier"]:
+            return None
+        if not os.path.exists(path):
+            logger.info("No type classifier trained, document types come from OCR keywords")
+            return None
+        return self._timed_load("type_classifier", DocumentTypeClassifier.load, path)
+    
+    def _register_custom_models(self):
+        """Register custom models from the config and route their document types"""
+        self.custom_models = {}
+        self.custom_routes = {}
+        for entry in self.config["custom_models"]:
+            try:
+                descriptor = self._read_custom_model_descriptor(entry)
+            except Exception as e:
+                logger.error(f"Skipping custom model {entry.get('name')}: {str(e)}")
+                continue
+            
+            self.custom_models[entry["name"]] = descriptor
+            self.model_manager.register(
+                f"custom:{entry['name']}", partial(self._load_custom_model, descriptor),
+                _path_nbytes(descriptor["model_path"]), attach=False
+            )
+            for doc_type in entry.get("document_types", []):
+                self.custom_routes[doc_type] = entry["name"]
+        
+        if self.custom_models:
+            logger.info(f"Custom models registered: {', '.join(self.custom_models)}")
+    
+    def _read_custom_model_descriptor(self, entry):
+        """Read a custom model's JSON config, resolving its model file next to it"""
+        with open(entry["config_file"], "r") as f:
+            descriptor = json.load(f)
+        descriptor["model_path"] = os.path.join(os.path.dirname(entry["config_file"]), descriptor["model_file"])
+        descriptor.setdefault("confidence_threshold", self.config["confidence_threshold"])
+        return descriptor
+    
+    def _load_custom_model(self, descriptor):
+        """Load a custom model in whichever format its descriptor declares"""
+        path = descriptor["model_path"]
+        
+        def load():
+            if descriptor["model_type"] == "pytorch":
+                try:
+                    return torch.jit.load(path, map_location="cpu").eval()
+                except RuntimeError:
+                    return torch.load(path, map_location="cpu", weights_only=False).eval()
+            if descriptor["model_type"] == "tensorflow":
+                return tf.keras.models.load_model(path)
+            if descriptor["model_type"] == "onnx":
+                return OnnxModel(path, _onnx_session_options(self.config))
+            raise ValueError(f"Unsupported custom model type: {descriptor['model_type']}")
+        
+        return {"model": self._timed_load(f"custom_{descriptor['model_name']}", load)}
+    
+    def _on_reload_signal(self, signum, frame):
+        """SIGHUP handler, reloading on a thread so the signal handler returns at once"""
+        threading.Thread(target=self.reload_custom_models, daemon=True).start()
+    
+    def reload_custom_models(self):
+        """Re-read custom model descriptors, swap in any model whose version changed
+        and drop the ones no longer configured
+        
+        A model is dropped when its entry leaves custom_models or its
+        configuration file is deleted. Reloads run one at a time, so quick
+        successive signals can't swap the same model concurrently.
+        """
+        if getattr(self, "model_manager", None) is None:
+            logger.warning("Reload requested but no local models are loaded (yet), ignoring")
+            return
+        with self._reload_lock:
+            self._reload_custom_models()
+    
+    def _reload_custom_models(self):
+        logger.info("Reloading custom models...")
+        routes, configured = {}, set()
+        for entry in self.config["custom_models"]:
+            name = entry["name"]
+            if not os.path.exists(entry["config_file"]):
+                continue
+            try:
+                descriptor = self._read_custom_model_descriptor(entry)
+                key = f"custom:{name}"
+                if not self.model_manager.is_registered(key):
+                    self.model_manager.register(
+                        key, partial(self._load_custom_model, descriptor),
+                        _path_nbytes(descriptor["model_path"]), attach=False)
+                elif descriptor != self.custom_models.get(name):
+                    self.model_manager.swap(
+                        key, partial(self._load_custom_model, descriptor), _path_nbytes(descriptor["model_path"]))
+                self.custom_models[name] = descriptor
+            except Exception as e:
+                logger.error(f"Failed to reload custom model {name}, keeping current version: {str(e)}")
+                if name not in self.custom_models:
+                    continue
+            
+            configured.add(name)
+            for doc_type in entry.get("document_types", []):
+                routes[doc_type] = name
+        
+        # Route away from removed models before forgetting them
+        self.custom_routes = routes
+        for name in [name for name in self.custom_models if name not in configured]:
+            del self.custom_models[name]
+            self.model_manager.unregister(f"custom:{name}")
+            logger.info(f"Custom model {name} removed")
+        logger.info("Custom models reloaded")
+    
+    def _analyze_with_custom_model(self, name, scan, doc_type):
+        """Classify a document with a registered custom model"""
+        descriptor = self.custom_models[name]
+        model = self.model_manager.get(f"custom:{name}")["model"]
+        
+        height, width = descriptor["input_size"]
+        image = cv2.resize(scan.rgb(), (width, height)).astype(np.float32) / 255
+        if descriptor.get("preprocessing") == "normalize":
+            image = (image - [0.485, 0.456, 0.406]) / [0.229, 0.224, 0.225]
+        batch = image[np.newaxis].astype(np.float32)  # NHWC
+        
+        if descriptor["model_type"] == "tensorflow":
+            scores = model.predict(batch, verbose=0)
+        else:
+            # PyTorch models take NCHW; ONNX exports say which layout they expect
+            if descriptor["model_type"] == "pytorch" or model.input_shape[-1] not in (1, 3):
+                batch = np.ascontiguousarray(batch.transpose(0, 3, 1, 2))
+            if descriptor["model_type"] == "onnx":
+                scores = model.run(batch)[0]
+            else:
+                with torch.no_grad():
+                    scores = model(torch.from_numpy(batch)).numpy()
+        
+        scores = np.asarray(scores, dtype=np.float64).reshape(-1)
+        if scores.min() < 0 or not np.isclose(scores.sum(), 1.0):
+            scores = np.exp(scores - scores.max())
+            scores /= scores.sum()
+        
+        labels = descriptor.get("class_labels") or [str(i) for i in range(len(scores))]
+        best = int(np.argmax(scores))
+        return {
+            "document_type": doc_type,
+            "model": descriptor["model_name"],
+            "prediction": labels[best],
+            "confidence": float(scores[best]),
+            "confident": bool(scores[best] >= descriptor["confidence_threshold"]),
+            "class_scores": {label: float(score) for label, score in zip(labels, scores)}
+        }
+    
+    def _load_xray_model(self):
+        """X-Ray analysis model"""
+        if self._uses_onnx("xray"):
+            return {
+                "xray_processor": self._timed_load(
+                    "xray_processor", ViTImageProcessor.from_pretrained, "medical-ai/xray-vit-base"),
+                "xray_model": self._timed_load("xray_model", self._load_onnx_model, "xray")
+            }
+        
+        if self.weight_pack is not None and "xray" in self.weight_pack:
+            return {
+                "xray_processor": self._timed_load(
+                    "xray_processor", ViTImageProcessor.from_pretrained, "medical-ai/xray-vit-base"),
+                "xray_model": self._timed_load(
+                    "xray_model", self.weight_pack.load_torch, "xray",
+                    lambda meta: AutoModelForImageClassification.from_config(AutoConfig.for_model(**meta["config"])))
+            }
+        
+        return {
+            "xray_processor": self._timed_load(
+                "xray_processor", ViTImageProcessor.from_pretrained, "medical-ai/xray-vit-base"),
+            "xray_model": self._timed_load(
+                "xray_model", AutoModelForImageClassification.from_pretrained, "medical-ai/xray-vit-base")
+        }
+    
+    def _load_mri_model(self):
+        """MRI analysis model"""
+        if self._uses_onnx("mri"):
+            return {"mri_model": self._timed_load("mri_model", self._load_onnx_model, "mri")}
+        
+        if self.weight_pack is not None and "mri" in self.weight_pack:
+            from torchvision.models import resnet50
+            return {"mri_model": self._timed_load(
+                "mri_model", self.weight_pack.load_torch, "mri", lambda meta: resnet50())}
+        
+        mri_model = self._timed_load(
+            "mri_backbone", torch.hub.load, 'pytorch/vision:v0.10.0', 'resnet50', pretrained=True)
+        mri_model.load_state_dict(
+            self._timed_load("mri_weights", torch.load, f"{self.config['models_path']}/mri_model.pth"))
+        mri_model.eval()
+        return {"mri_model": mri_model}
+    
+    def _load_ct_model(self):
+        """CT scan analysis model"""
+        if self._uses_onnx("ct"):
+            return {"ct_model": self._timed_load("ct_model", self._load_onnx_model, "ct")}
+        
+        if self.weight_pack is not None and "ct" in self.weight_pack:
+            return {"ct_model": self._timed_load("ct_model", self.weight_pack.load_keras, "ct")}
+        
+        return {"ct_model": self._timed_load(
+            "ct_model", tf.keras.models.load_model, f"{self.config['models_path']}/ct_model")}
+    
+    def _load_ecg_model(self):
+        """ECG analysis model"""
+        if self._uses_onnx("ecg"):
+            return {"ecg_model": self._timed_load("ecg_model", self._load_onnx_model, "ecg")}
+        
+        if self.weight_pack is not None and "ecg" in self.weight_pack:
+            return {"ecg_model": self._timed_load("ecg_model", self.weight_pack.load_keras, "ecg")}
+        
+        return {"ecg_model": self._timed_load(
+            "ecg_model", tf.keras.models.load_model, f"{self.config['models_path']}/ecg_model")}
+    
+    def _load_report_model(self):
+        """General medical report analyzer"""
+        if self._uses_onnx("text_report"):
+            from optimum.onnxruntime import ORTModelForSeq2SeqLM
+            return {
+                "report_tokenizer": self._timed_load(
+                    "report_tokenizer", AutoTokenizer.from_pretrained, "medical-ai/medrpt-bert-base"),
+                "report_model": self._timed_load(
+                    "report_model", ORTModelForSeq2SeqLM.from_pretrained,
+                    self._onnx_model_path("text_report"),
+                    session_options=_onnx_session_options(self.config))
+            }
+        
+        if self.weight_pack is not None and "text_report" in self.weight_pack:
+            return {
+                "report_tokenizer": self._timed_load(
+                    "report_tokenizer", AutoTokenizer.from_pretrained, "medical-ai/medrpt-bert-base"),
+                "report_model": self._timed_load(
+                    "report_model", self.weight_pack.load_torch, "text_report",
+                    lambda meta: AutoModelForSeq2SeqLM.from_config(AutoConfig.for_model(**meta["config"])))
+            }
+        
+        return {
+            "report_tokenizer": self._timed_load(
+                "report_tokenizer", AutoTokenizer.from_pretrained, "medical-ai/medrpt-bert-base"),
+            "report_model": self._timed_load(
+                "report_model", AutoModelForSeq2SeqLM.from_pretrained, "medical-ai/medrpt-bert-base")
+        }
+    
+    def _warm_up(self, iterations=None):
+        """Run synthetic inputs through each loaded model and the OCR path
+        
+        With lazy loading nothing is resident yet, so the warmup_models are
+        loaded first; other modalities still pay their first inference on use.
+        """
+        logger.info("Warming up models...")
+        blank = np.full((224, 224, 3), 255, dtype=np.uint8)
+        passes = {}
+        
+        if self.model_manager is not None:
+            for key in self.config["warmup_models"]:
+                if self.model_manager.is_registered(key):
+                    try:
+                        self.model_manager.ensure(key)
+                    except Exception as e:
+                        logger.warning(f"Could not load {key} model for warm-up: {str(e)}")
+            for key in self.model_manager.resident_keys():
+                passes[f"{key}_model"] = partial(self._run_model_pass, key, blank)
+        
+        for lang, translator in self.translators.items():
+            passes[f"translator_{lang}"] = partial(
+                self._warm_up_seq2seq, translator["tokenizer"], translator["model"])
+        
+        page = np.full((200, 1200), 255, dtype=np.uint8)
+        cv2.putText(page, "X-RAY REPORT HAEMOGLOBIN 13.5 g/dL", (20, 120),
+                    cv2.FONT_HERSHEY_SIMPLEX, 1.2, 0, 2)
+        passes["ocr"] = partial(OcrResult.from_image, page, self.config["ocr_language"])
+        
+        for name, run in passes.items():
+            try:
+                timings = []
+                with self.profiler.phase(name):
+                    for _ in range(iterations or max(self.config["warmup_iterations"], 2)):
+                        start = time.time()
+                        run()
+                        timings.append(time.time() - start)
+                
+                self.warmup_stats[name] = {
+                    "first_inference_s": timings[0],
+                    "steady_state_s": statistics.median(timings[1:] or timings)
+                }
+                logger.info(
+                    f"Warm-up {name}: first {timings[0] * 1000:.0f} ms, "
+                    f"steady {self.warmup_stats[name]['steady_state_s'] * 1000:.0f} ms"
+                )
+            except Exception as e:
+                logger.warning(f"Warm-up of {name} failed: {str(e)}")
+    
+    def _run_model_pass(self, key, image):
+        """Run one inference of the model for key on a BGR image"""
+        with torch.no_grad():
+            if key == "xray":
+                rgb = cv2.cvtColor(image, cv2.COLOR_BGR2RGB)
+                return self.xray_model(**self.xray_processor(images=Image.fromarray(rgb), return_tensors="pt"))
+            
+            if key == "mri":
+                rgb = cv2.resize(cv2.cvtColor(image, cv2.COLOR_BGR2RGB), (224, 224)).astype(np.float32) / 255
+                rgb = (rgb - [0.485, 0.456, 0.406]) / [0.229, 0.224, 0.225]
+                return self.mri_model(torch.from_numpy(rgb.astype(np.float32)).permute(2, 0, 1).unsqueeze(0))
+            
+            if key in ("ct", "ecg"):
+                model = getattr(self, f"{key}_model")
+                _, height, width, channels = model.input_shape
+                resized = cv2.resize(image, (width, height))
+                if channels == 1:
+                    resized = cv2.cvtColor(resized, cv2.COLOR_BGR2GRAY)[..., np.newaxis]
+                return model.predict(resized[np.newaxis].astype(np.float32) / 255, verbose=0)
+            
+            if key == "text_report":
+                return self._warm_up_seq2seq(self.report_tokenizer, self.report_model)
+        
+        raise ValueError(f"No model pass defined for {key}")
+    
+    def _warm_up_seq2seq(self, tokenizer, model):
+        """Tokenize and generate a few tokens from a short medical sentence"""
+        inputs = tokenizer("Haemoglobin is within the normal range.", return_tensors="pt")
+        with torch.no_grad():
+            return model.generate(**inputs, max_new_tokens=8)
+    
+    def _uses_onnx(self, key):
+        """Quantized variants only exist as ONNX models, whatever the backend"""
+        return self.config["inference_backend"] == "onnx" or self.config["quantized_models"].get(key, False)
+    
+    def _onnx_model_path(self, key):
+        """Path of the exported model for key, picking the int8 variant when configured"""
+        suffix = "_int8" if self.config["quantized_models"].get(key, False) else ""
+        if key == "text_report":
+            return f"{self.config['onnx_models_path']}/text_report{suffix}"
+        return f"{self.config['onnx_models_path']}/{key}{suffix}.onnx"
+    
+    def _load_onnx_model(self, key):
+        """Open an exported model with the shared ONNX session options"""
+        return OnnxModel(self._onnx_model_path(key), _onnx_session_options(self.config))
+    
     def _init_language_processing(self):
         """Initialize NLP components for report analysis and translation"""
         logger.info("Initializing language processing components...")
@@ -190,17 +2642,24 @@ class MedicalImagingSystem:
         try:
             # Load medical terminology database
             with open(f"{self.config['models_path']}/medical_terminology.json", "r") as f:
-                self.medical_terms = json.load(f)
+                self.medical_terms = self._timed_load("medical_terminology", json.load, f)
+            self.keyword_matcher = build_keyword_matcher(self.medical_terms)
             
             # Load translation models for supported languages
-            self.translators = {}
+            loaders = {}
             for lang in self.config["supported_languages"]:
                 if lang != "english":
                     model_name = f"Helsinki-NLP/opus-mt-en-{lang}"
-                    self.translators[lang] = {
-                        "tokenizer": AutoTokenizer.from_pretrained(model_name),
-                        "model": AutoModelForSeq2SeqLM.from_pretrained(model_name)
-                    }
+                    loaders[(lang, "tokenizer")] = partial(
+                        self._timed_load, f"translator_{lang}_tokenizer",
+                        AutoTokenizer.from_pretrained, model_name)
+                    loaders[(lang, "model")] = partial(
+                        self._timed_load, f"translator_{lang}_model",
+                        AutoModelForSeq2SeqLM.from_pretrained, model_name)
+            
+            self.translators = {}
+            for (lang, part), artifact in self._load_artifacts(loaders).items():
+                self.translators.setdefault(lang, {})[part] = artifact
             
             logger.info("Language processing components initialized")
         except Exception as e:
@@ -212,17 +2671,48 @@ class MedicalImagingSystem:
         logger.info("Initializing audio system...")
         
         try:
-            pygame.mixer.init()
-            pygame.mixer.music.set_volume(self.config["audio_volume"])
+            # SDL's audio thread doesn't survive fork, so fork server workers open the mixer
+            if self.config["fork_server_mode"] == "off":
+                self.profiler.run("mixer", self._init_audio_output)
             
-            # Pre-generate common system messages
-            self._generate_system_audio_messages()
+            # Pre-generate common system messages. Translating runs torch inference, which would start
+            # thread pools a fork server parent must not have, so a short-lived child fills the cache there
+            if self.config["fork_server_mode"] != "off":
+                self.profiler.run("system_messages_child", self._generate_system_audio_in_child)
+            self.profiler.run("system_messages", self._generate_system_audio_messages)
             
             logger.info("Audio system initialized")
         except Exception as e:
             logger.error(f"Failed to initialize audio system: {str(e)}")
             raise RuntimeError(f"Audio system initialization failed: {str(e)}")
     
+    def _init_audio_output(self):
+        """Open the audio mixer"""
+        # Replay runs play prompts in real time through SDL's silent driver
+        if self.config["hardware_backend"] == "replay":
+            os.environ.setdefault("SDL_AUDIODRIVER", "dummy")
+        pygame.mixer.init()
+        pygame.mixer.music.set_volume(self.config["audio_volume"])
+    
+    def _generate_system_audio_in_child(self):
+        """Fill the system audio cache from a forked child, keeping inference out of this process"""
+        pid = os.fork()
+        if pid == 0:
+            exit_code = 1
+            try:
+                self._generate_system_audio_messages()
+                exit_code = 0
+            except Exception as e:
+                logger.error(f"System audio generation failed: {str(e)}")
+            finally:
+                for handler in logging.getLogger().handlers:
+                    handler.flush()
+                os._exit(exit_code)
+        
+        _, status = os.waitpid(pid, 0)
+        if os.waitstatus_to_exitcode(status) != 0:
+            raise RuntimeError("System audio could not be generated")
+    
     def _generate_system_audio_messages(self):
         """Pre-generate common system audio messages"""
         system_messages = {
@@ -230,22 +2720,57 @@ class MedicalImagingSystem:
             "scanning": "Scanning your document. Please wait.",
             "analyzing": "Document scanned. Now analyzing the results.",
             "error": "An error occurred. Please try again.",
-            "complete": "Analysis complete. I will now read the results."
+            "complete": "Analysis complete. I will now read the results.",
+            "not_ready": "The system is still starting up. Please wait a moment and press the button again.",
+            "rescan": "The scan could not be read. Please place the document flat on the glass and press the button again."
         }
         
+        # Clips are cached by content hash, so only changed messages or
+        # newly added languages need translation and gTTS at boot
+        cache_path = self.config["audio_cache_path"]
+        os.makedirs(cache_path, exist_ok=True)
+        
         self.system_audio = {}
+        generated = 0
         for lang in self.config["supported_languages"]:
             self.system_audio[lang] = {}
             for msg_key, msg_text in system_messages.items():
-                if lang != "english":
-                    # Translate message
-                    msg_text = self._translate_text(msg_text, lang)
+                audio_file = os.path.join(cache_path, f"{self._system_audio_key(msg_text, lang)}.mp3")
+                
+                if not os.path.exists(audio_file):
+                    if lang != "english":
+                        # Translate message
+                        with self.profiler.phase(f"translate.{lang}.{msg_key}"):
+                            msg_text = self._translate_text(msg_text, lang)
+                    
+                    # Generate audio file, renaming into place so a crash never leaves a partial clip
+                    with self.profiler.phase(f"tts.{lang}.{msg_key}"):
+                        tts = gTTS(text=msg_text, lang=self._get_gtts_lang_code(lang), tld=self.config["tts_tld"])
+                        tts.save(f"{audio_file}.tmp")
+                    os.replace(f"{audio_file}.tmp", audio_file)
+                    generated += 1
                 
-                # Generate audio file
-                audio_file = f"{self.config['temp_path']}/system_{lang}_{msg_key}.mp3"
-                tts = gTTS(text=msg_text, lang=self._get_gtts_lang_code(lang))
-                tts.save(audio_file)
                 self.system_audio[lang][msg_key] = audio_file
+        
+        # Drop clips for messages or languages that are no longer in use; anything
+        # not named like a cached clip belongs to someone else and is left alone
+        in_use = {os.path.basename(path) for clips in self.system_audio.values() for path in clips.values()}
+        for name in os.listdir(cache_path):
+            if name not in in_use and re.fullmatch(r"[0-9a-f]{64}\.mp3(\.tmp)?", name):
+                os.remove(os.path.join(cache_path, name))
+        
+        logger.info(f"System audio ready: {generated} clips generated, {len(in_use) - generated} from cache")
+    
+    def _system_audio_key(self, msg_text, language):
+        """Content hash identifying a system audio clip"""
+        source = {
+            "text": msg_text,
+            "language": language,
+            "engine": "gtts",
+            "voice": f"{self._get_gtts_lang_code(language)}-{self.config['tts_tld']}",
+            "translator": None if language == "english" else f"Helsinki-NLP/opus-mt-en-{language}"
+        }
+        return hashlib.sha256(json.dumps(source, sort_keys=True).encode("utf-8")).hexdigest()
     
     def _get_gtts_lang_code(self, language):
         """Convert our language names to gTTS language codes"""
@@ -260,22 +2785,39 @@ class MedicalImagingSystem:
         """Handle button press event"""
         logger.info("Button pressed, initiating scan and analysis")
         
+        # Refuse scans until models are loaded and warmed up
+        if not self.ready.is_set():
+            logger.warning("System is not ready yet, ignoring button press")
+            if hasattr(self, "system_audio"):
+                self.play_system_audio("not_ready")
+            return
+        
+        # In per-job fork server mode every scan runs in a fresh worker
+        if self.config["fork_server_mode"] == "per_job" and not self._in_worker:
+            self._run_job_in_worker(channel)
+            return
+        
         # Indicate processing with status LED
-        import RPi.GPIO as GPIO
+        GPIO = self.gpio
         GPIO.output(self.config["led_status_pin"], GPIO.HIGH)
         
         try:
             # Play audio notification
             self.play_system_audio("scanning")
             
-            # Perform document scan
-            scan_path = self.scan_document()
-            
-            # Play analyzing audio
-            self.play_system_audio("analyzing")
-            
-            # Process the scanned document
-            result = self.analyze_document(scan_path)
+            if self.config["adf_batch_mode"]:
+                # Pages are analyzed while the feeder is still pulling in the rest of the stack
+                result = self.analyze_batch(
+                    self.scan_batch(), on_scanned=lambda: self.play_system_audio("analyzing"))
+            else:
+                # Perform document scan
+                scan = self.scan_document()
+                
+                # Play analyzing audio
+                self.play_system_audio("analyzing")
+                
+                # Process the scanned document
+                result = self.analyze_document(scan)
             
             # Play completion audio
             self.play_system_audio("complete")
@@ -283,6 +2825,10 @@ class MedicalImagingSystem:
             # Generate and play result audio
             self.generate_and_play_result(result)
             
+            # Pages the quality gate turned away from a batch need scanning again
+            if result.get("rejected_pages"):
+                self.play_system_audio("rescan")
+            
             # Turn off status LED
             GPIO.output(self.config["led_status_pin"], GPIO.LOW)
             
@@ -293,13 +2839,44 @@ class MedicalImagingSystem:
             GPIO.output(self.config["led_status_pin"], GPIO.LOW)
             GPIO.output(self.config["led_error_pin"], GPIO.HIGH)
             
-            # Play error audio
+            # Play error audio, asking for a new scan if the page itself was unusable
             self.play_system_audio("error")
+            if isinstance(e, ScanQualityError):
+                self.play_system_audio("rescan")
             
             # Turn off error LED after delay
             time.sleep(3)
             GPIO.output(self.config["led_error_pin"], GPIO.LOW)
     
+    def _run_job_in_worker(self, channel):
+        """Fork a worker for one scan, sharing loaded models copy-on-write"""
+        pid = os.fork()
+        if pid == 0:
+            exit_code = 1
+            try:
+                self._in_worker = True
+                self._init_audio_output()
+                self._button_callback(channel)
+                exit_code = 0
+            finally:
+                # Let the background archive write finish before the worker exits
+                if self.archive_executor is not None:
+                    self.archive_executor.shutdown(wait=True)
+                for handler in logging.getLogger().handlers:
+                    handler.flush()
+                os._exit(exit_code)
+        
+        _, status = os.waitpid(pid, 0)
+        self.scanner_settings = {}  # the worker may have reconfigured the scanner session
+        if os.WIFSIGNALED(status):
+            # The worker died without reporting, so signal the error here
+            logger.error(f"Scan worker {pid} killed by signal {os.WTERMSIG(status)}")
+            GPIO = self.gpio
+            GPIO.output(self.config["led_status_pin"], GPIO.LOW)
+            GPIO.output(self.config["led_error_pin"], GPIO.HIGH)
+            time.sleep(3)
+            GPIO.output(self.config["led_error_pin"], GPIO.LOW)
+    
     def play_system_audio(self, message_key):
         """Play a pre-generated system audio message"""
         language = self.current_language or self.config["default_language"]
@@ -318,75 +2895,586 @@ class MedicalImagingSystem:
         output_path = f"{self.config['temp_path']}/scan_{timestamp}.png"
         
         try:
-            # Configure scanner settings
-            self.scanner.set_resolution(self.config["scan_resolution"])
-            self.scanner.set_color_mode("color")
-            self.scanner.set_document_size(self.config["max_scan_size"])
+            # The modality switch picks the scan profile, otherwise a quick preview guesses it
+            profile_name, preview = self._switch_scan_profile(), None
+            if profile_name is None and self.config["adaptive_scan"]:
+                preview = self._scan_preview()
+                profile_name = preview["document_class"]
+            profile = self._apply_scan_profile(profile_name or "default")
             
-            # Perform scan
-            scan_successful = self.scanner.scan(output_path)
+            # Perform scan, analyzing the top of the page while the rest is acquired if possible
+            scan_start = time.time()
+            if self.config["streaming_scan"] and hasattr(self.scanner, "scan_bands"):
+                scan = self._scan_streaming(output_path)
+            else:
+                scan = self._scan_page(output_path)
             
-            if not scan_successful:
+            if scan is None:
                 raise RuntimeError("Scanner failed to complete scan operation")
             
+            if preview:
+                self._record_scan_stats({
+                    "document_class": preview["document_class"],
+                    "profile": profile,
+                    "preview_s": round(preview["seconds"], 3),
+                    "scan_s": round(time.time() - scan_start, 3),
+                    "preview_bytes": preview["bytes"],
+                    "scan_bytes": self._scan_bytes(profile, scan.image.shape, profile["resolution"]),
+                    "baseline_bytes": self._scan_bytes(self._scan_profile("default"), scan.image.shape, profile["resolution"])
+                })
+            
+            # Stop here if the page isn't worth OCR and inference; streaming scans were checked as they arrived
+            if self.config["quality_gate"] and "quality" not in scan.hints:
+                self._check_scan_quality(scan)
+            
+            # Drop the empty bed around small documents and straighten them
+            if self.config["auto_crop"]:
+                self._crop_scan(scan)
+            
+            # Analysis works on the pixels in memory, the file is only kept for the record
+            if not scan.on_disk:
+                self._archive_scan(scan)
+            
             logger.info(f"Document scanned successfully: {output_path}")
-            return output_path
+            return scan
             
+        except ScanQualityError:
+            raise
         except Exception as e:
             logger.error(f"Scan failed: {str(e)}")
             raise RuntimeError(f"Failed to scan document: {str(e)}")
     
-    def analyze_document(self, document_path):
-        """Analyze the scanned document"""
-        logger.info(f"Analyzing document: {document_path}")
+    def scan_batch(self):
+        """Acquire every page in the document feeder, yielding each as soon as it is scanned"""
+        logger.info("Initiating batch scan from the document feeder")
+        if not hasattr(self.scanner, "scan_feeder"):
+            raise RuntimeError("Scanner has no document feeder")
+        
+        timestamp = int(time.time())
+        self._apply_scan_profile(self._switch_scan_profile() or "default")
+        
+        # Stop before asking for the page after the limit, so it is never fed and scanned
+        pages = 0
+        feeder = self.scanner.scan_feeder()
+        try:
+            for image in itertools.islice(feeder, self.config["max_batch_pages"]):
+                pages += 1
+                image = self._calibrate(image)
+                
+                scan = ScanBuffer(image, f"{self.config['temp_path']}/scan_{timestamp}_p{pages}.png",
+                                  hints={"page": pages})
+                if self.config["quality_gate"]:
+                    # A bad page is reported on its own, the rest of the stack is still analyzed
+                    try:
+                        self._check_scan_quality(scan)
+                    except ScanQualityError as e:
+                        logger.warning(f"Page {pages} {str(e)}")
+                        scan.hints["quality_error"] = e
+                        yield scan
+                        continue
+                if self.config["auto_crop"]:
+                    self._crop_scan(scan)
+                self._archive_scan(scan)
+                
+                logger.info(f"Page {pages} scanned: {scan}")
+                yield scan
+        finally:
+            if hasattr(feeder, "close"):
+                feeder.close()
+        
+        if pages == self.config["max_batch_pages"]:
+            logger.warning(f"Stopped batch at the {pages} page limit, any further pages stay in the feeder")
+        if not pages:
+            raise RuntimeError("Document feeder is empty")
+    
+    def _scan_profile(self, name):
+        """Scanner settings of a named profile; "default" is scan_resolution in colour unless overridden"""
+        default = {"resolution": self.config["scan_resolution"], "color_mode": "color", "bit_depth": 8}
+        return dict(default, **self.config["scan_profiles"].get(name, {}))
+    
+    def _apply_scan_profile(self, name):
+        """Switch the scanner session to a profile, only sending the settings that change"""
+        profile = self._scan_profile(name)
+        wanted = dict(profile, document_size=self.config["max_scan_size"])
+        setters = {
+            "resolution": self.scanner.set_resolution,
+            "color_mode": self.scanner.set_color_mode,
+            "bit_depth": getattr(self.scanner, "set_bit_depth", None),
+            "document_size": self.scanner.set_document_size
+        }
+        for setting, value in wanted.items():
+            if self.scanner_settings.get(setting) != value and setters.get(setting) is not None:
+                setters[setting](value)
+                self.scanner_settings[setting] = value
+        
+        logger.info(f"Scan profile {name}: {profile['resolution']} DPI {profile['color_mode']}, "
+                    f"{profile['bit_depth']}-bit")
+        return profile
+    
+    def _switch_scan_profile(self):
+        """Profile selected on the modality switch, None if no position is wired or selected"""
+        for name, pin in self.config["scan_profile_switch_pins"].items():
+            if self.gpio.input(pin) == self.gpio.LOW:
+                return name
+        return None
+    
+    def _scan_preview(self):
+        """Low-resolution colour pass used only to classify the document"""
+        start = time.time()
+        preview_path = f"{self.config['temp_path']}/preview_{int(start)}.png"
+        
+        profile = self._apply_scan_profile("preview")
+        preview = self._scan_page(preview_path)
+        if preview is None:
+            raise RuntimeError("Scanner failed to complete preview scan")
+        if preview.on_disk:
+            os.remove(preview_path)
+        
+        document_class = _classify_preview(preview.image)
+        logger.info(f"Preview classified as {document_class}")
+        return {
+            "document_class": document_class,
+            "seconds": time.time() - start,
+            "bytes": self._scan_bytes(profile, preview.image.shape, profile["resolution"])
+        }
+    
+    def _scan_page(self, path):
+        """One scanner pass as a ScanBuffer, None if the scan failed
+        
+        Drivers that can hand over pixels skip the file entirely; the rest
+        write it themselves and it is decoded once here.
+        """
+        if hasattr(self.scanner, "scan_to_array"):
+            image = self.scanner.scan_to_array()
+            return ScanBuffer(self._calibrate(image), path) if image is not None else None
+        
+        if not self.scanner.scan(path):
+            return None
+        scan = ScanBuffer.from_file(path)
+        self._calibrate(scan.image)
+        return scan
+    
+    def _load_calibration(self):
+        """This scanner's lookup tables as (color, gray), None if it hasn't been calibrated"""
+        path = _calibration_file(self.config, self.scanner.get_device_info())
+        if not os.path.exists(path):
+            logger.info("No scanner calibration found, scans are used as delivered")
+            return None
+        
+        lut = np.load(path)
+        logger.info(f"Scanner calibration loaded from {path}")
+        return np.ascontiguousarray(lut[:3].T.reshape(256, 1, 3)), np.ascontiguousarray(lut[3])
+    
+    def _calibrate(self, image):
+        """Apply the calibration tables to freshly acquired pixels, in place where possible"""
+        if self.calibration is None or self.scanner_settings.get("bit_depth") == 1:
+            return image
+        
+        lut = self.calibration[0] if image.ndim == 3 else self.calibration[1]
+        if not image.flags.writeable:
+            return cv2.LUT(image, lut)
+        cv2.LUT(image, lut, dst=image)
+        return image
+    
+    def _check_scan_quality(self, scan):
+        """Raise ScanQualityError when a scan is blurry, badly exposed, blank or too crooked"""
+        start = time.time()
+        metrics = assess_scan_quality(scan.image)
+        scan.hints["quality"] = metrics
+        problems = self._quality_problems(metrics)
+        
+        logger.info(f"Scan quality checked in {(time.time() - start) * 1000:.0f} ms: "
+                    + ", ".join(f"{name}={value:.3g}" for name, value in metrics.items()))
+        if problems:
+            raise ScanQualityError(problems, metrics)
+    
+    def _quality_problems(self, metrics):
+        """The quality_limits that a scan's metrics break, by name"""
+        limits = self.config["quality_limits"]
+        if metrics["ink"] < limits["min_ink"]:
+            return ["blank page"]
+        
+        problems = []
+        if metrics["sharpness"] < limits["min_sharpness"]:
+            problems.append("blurred")
+        if metrics["dark_level"] > limits["max_dark_level"]:
+            problems.append("overexposed")
+        if metrics["bright_level"] < limits["min_bright_level"]:
+            problems.append("underexposed")
+        if abs(metrics["skew"]) > limits["max_skew"]:
+            problems.append("crooked")
+        return problems
+    
+    def _crop_scan(self, scan):
+        """Replace a scan's image with its tight, upright crop"""
+        start = time.time()
+        cropped, box, angle = _crop_document(scan.image, self.config["crop_max_skew"])
+        if cropped.shape == scan.image.shape:
+            return
+        
+        saved = 1 - cropped.shape[0] * cropped.shape[1] / (scan.image.shape[0] * scan.image.shape[1])
+        scan.image = cropped
+        scan.hints["crop"] = {"box": box, "skew": angle}
+        logger.info(f"Cropped scan to {box[2]}x{box[3]}, rotated {angle:.1f} degrees, "
+                    f"{saved:.0%} fewer pixels in {(time.time() - start) * 1000:.0f} ms")
+    
+    def _archive_scan(self, scan):
+        """Write a scan to its path on a background thread"""
+        # Created on first use so fork server parents never start the thread
+        if self.archive_executor is None:
+            self.archive_executor = ThreadPoolExecutor(max_workers=1, thread_name_prefix="scan-archive")
+        scan.archived = self.archive_executor.submit(cv2.imwrite, scan.path, scan.image)
+    
+    def _scan_bytes(self, profile, shape, resolution):
+        """Raw pixel bytes profile would give for a page scanned as shape at resolution
         
+        Arrays hold at least a byte per sample whatever the scanner's bit
+        depth, so every byte count goes through here to stay in one unit.
+        """
+        scale = profile["resolution"] / resolution
+        channels = 3 if profile["color_mode"] == "color" else 1
+        return int(shape[0] * scale) * int(shape[1] * scale) * channels * profile["bit_depth"] // 8
+    
+    def _record_scan_stats(self, entry):
+        """Append one adaptive scan's timings to the per-class statistics"""
         try:
-            # Determine document type
-            doc_type = self._detect_document_type(document_path)
-            logger.info(f"Detected document type: {doc_type}")
+            with open(f"{self.config['output_path']}/scan_stats.jsonl", "a") as f:
+                f.write(json.dumps(entry) + "\n")
+        except OSError as e:
+            logger.warning(f"Could not record scan statistics: {str(e)}")
+    
+    def _scan_streaming(self, output_path):
+        """Acquire the page in horizontal bands, OCRing and classifying the top
+        of the page while the carriage is still moving
+        
+        Chunks are read as acquired, without deskewing: a skew estimate from
+        the first strip is unreliable, and rotating each chunk on its own
+        shifts text across the seams. Tesseract copes with the small angles a
+        page lies at, and _crop_scan straightens the full page afterwards.
+        Chunks are OCR'd concurrently on the shared OCR pool, header first.
+        Once a modality keyword shows up its model starts loading in the
+        background. With the quality gate on, chunks are held until the rows
+        acquired so far first pass it (later chunks are not re-checked), and
+        the finished page is checked before the chunks held back are read, so
+        a rejected scan costs little or no OCR. When the page is complete the type classifier gets the first
+        word: if it confidently names an imaging modality, the OCR still
+        queued is dropped, since only reports need their text. The complete OCR
+        result and the classifier verdict are kept as hints on the returned
+        ScanBuffer for _detect_document_type and the analyzers.
+        """
+        chunk_rows = self.config["streaming_ocr_rows"]
+        overlap = self.config["streaming_ocr_overlap"]
+        bands, pending, parts = [], [], []
+        state = {"document_type": None, "passed": False}
+        
+        def process_chunk(gray, top):
+            result = OcrResult.from_image(gray, self.config["ocr_language"], origin=(0, top))
+            parts.append((result, top, top + gray.shape[0]))
             
-            # Process based on document type
-            if doc_type == "xray":
-                result = self._analyze_xray(document_path)
+            doc_type = self._match_document_type(result.text.lower())
+            if doc_type is not None and state["document_type"] is None:
+                state["document_type"] = doc_type
+                logger.info(f"Detected {doc_type} while scanning, preloading its model")
+                threading.Thread(target=self._preload_model, args=(doc_type,), daemon=True).start()
+        
+        def submit(chunk, top):
+            gray = cv2.cvtColor(chunk, cv2.COLOR_BGR2GRAY) if chunk.ndim == 3 else chunk
+            return self.ocr_executor.submit(process_chunk, gray, top)
+        
+        # Chunks overlap so text lines cut at a chunk edge are read whole in the next one
+        gate = self.config["quality_gate"]
+        futures = []
+        carry = []
+        held = []  # chunks waiting for the rows acquired so far to pass the quality gate
+        rows = 0
+        for band in self.scanner.scan_bands(self.config["scan_band_height"]):
+            band = self._calibrate(band)
+            bands.append(band)
+            pending.append(band)
+            rows += band.shape[0]
+            if sum(b.shape[0] for b in pending) >= chunk_rows:
+                chunk = np.vstack(carry + pending)
+                carry, pending = [chunk[-overlap:]], []
+                held.append((chunk, rows - chunk.shape[0]))
+                # Once the rows so far pass, later chunks go straight to OCR; the full page is checked at the end
+                if not gate or state["passed"] or not self._quality_problems(assess_scan_quality(np.vstack(bands))):
+                    state["passed"] = True
+                    futures += [submit(*args) for args in held]
+                    held = []
+        if pending:
+            chunk = np.vstack(carry + pending)
+            held.append((chunk, rows - chunk.shape[0]))
+        
+        if not bands:
+            return None
+        scan = ScanBuffer(np.vstack(bands), output_path)
+        if gate:
+            try:
+                self._check_scan_quality(scan)
+            except ScanQualityError:
+                for future in futures:
+                    future.cancel()
+                raise
+        
+        # Film and ECG pages don't need their text, so a confident classifier ends OCR here
+        if self.type_classifier is not None:
+            prediction = self.type_classifier.predict(scan.image)
+            scan.hints["type_prediction"] = prediction
+            if prediction[1] >= self.config["confidence_threshold"] and prediction[0] != "text_report":
+                dropped = sum(future.cancel() for future in futures) + len(held)
+                logger.info(f"Classified as {prediction[0]} ({prediction[1]:.2f}), skipping {dropped} OCR chunks")
+                return scan
+        
+        futures += [submit(*args) for args in held]
+        for future in futures:
+            future.result()
+        scan.hints["ocr"] = OcrResult.merge(sorted(parts, key=lambda part: part[1]))
+        return scan
+    
+    def _preload_model(self, doc_type):
+        """Load a document type's model ahead of analysis, errors are handled again at dispatch"""
+        try:
+            self._ensure_model(doc_type)
+        except Exception as e:
+            logger.warning(f"Preloading {doc_type} model failed: {str(e)}")
+    
+    def analyze_document(self, scan):
+        """Analyze the scanned document, a ScanBuffer or an image path"""
+        logger.info(f"Analyzing document: {scan}")
+        
+        try:
+            if not isinstance(scan, ScanBuffer):
+                scan = ScanBuffer.from_file(scan)
+            
+            # Separate slips on the bed are analyzed side by side
+            documents = self._split_documents(scan) if self.config["multi_document_scan"] else [scan]
+            if len(documents) > 1:
+                result = self._analyze_parts(documents, "document")
+            else:
+                result = self._analyze_scan(scan)
+            self._save_result(result)
+            return result
+            
+        except Exception as e:
+            logger.error(f"Analysis failed: {str(e)}")
+            raise RuntimeError(f"Failed to analyze document: {str(e)}")
+    
+    def _analyze_scan(self, scan):
+        """Detect a scan's document type and run the matching analyzer"""
+        if "quality_error" in scan.hints:
+            raise scan.hints["quality_error"]
+        
+        # Determine document type
+        doc_type = self._detect_document_type(scan)
+        logger.info(f"Detected document type: {doc_type}")
+        
+        # Process based on document type, loading its model on first use and
+        # keeping it resident while other pages of a batch load theirs
+        custom_model = self.custom_routes.get(doc_type) if self.model_manager is not None else None
+        with self.model_manager.hold(doc_type) if self.model_manager is not None else nullcontext():
+            if custom_model is not None:
+                result = self._analyze_with_custom_model(custom_model, scan, doc_type)
+            elif not self._ensure_model(doc_type):
+                result = self._analyze_via_api(scan, doc_type)
+            elif doc_type == "xray":
+                result = self._analyze_xray(scan)
             elif doc_type == "mri":
-                result = self._analyze_mri(document_path)
+                result = self._analyze_mri(scan)
             elif doc_type == "ct":
-                result = self._analyze_ct(document_path)
+                result = self._analyze_ct(scan)
             elif doc_type == "ecg":
-                result = self._analyze_ecg(document_path)
+                result = self._analyze_ecg(scan)
             elif doc_type == "text_report":
-                result = self._analyze_text_report(document_path)
+                result = self._analyze_text_report(scan)
             else:
                 # Use API for unknown document types
-                result = self._analyze_via_api(document_path, doc_type)
-            
-            # Save analysis result
-            timestamp = int(time.time())
-            result_path = f"{self.config['output_path']}/result_{timestamp}.json"
-            with open(result_path, "w") as f:
-                json.dump(result, f, indent=2)
-            
-            logger.info(f"Analysis complete, results saved to {result_path}")
-            return result
+                result = self._analyze_via_api(scan, doc_type)
+        
+        # Terminology in a report's text, for explaining it to the patient
+        if doc_type == "text_report":
+            result.setdefault("medical_terms", self._explain_medical_terms(self._ocr(scan).text))
+        
+        result.setdefault("document_type", doc_type)
+        return result
+    
+    def _save_result(self, result):
+        """Save an analysis result to the output directory"""
+        timestamp = int(time.time())
+        result_path = f"{self.config['output_path']}/result_{timestamp}.json"
+        with open(result_path, "w") as f:
+            json.dump(result, f, indent=2)
+        
+        logger.info(f"Analysis complete, results saved to {result_path}")
+    
+    def analyze_batch(self, scans, on_scanned=None):
+        """Analyze the pages of a batch concurrently as they arrive and merge the results
+        
+        on_scanned is called once the last page has been acquired.
+        """
+        result = self._analyze_parts(scans, "page", on_scanned)
+        self._save_result(result)
+        return result
+    
+    def _split_documents(self, scan):
+        """One ScanBuffer per separate document on the bed, cropped and straightened"""
+        boxes = _segment_documents(scan.image, self.config["min_document_area"])
+        if len(boxes) < 2:
+            return [scan]
+        
+        logger.info(f"Found {len(boxes)} documents on the scanner bed")
+        root, ext = os.path.splitext(scan.path)
+        documents = []
+        for number, (x, y, w, h) in enumerate(boxes, 1):
+            image, _, angle = _crop_document(scan.image[y:y + h, x:x + w], self.config["crop_max_skew"])
+            document = ScanBuffer(image, f"{root}_d{number}{ext}",
+                                  hints={"document": number, "box": (x, y, w, h), "skew": angle})
+            self._archive_scan(document)
+            documents.append(document)
+        return documents
+    
+    def _analyze_parts(self, scans, part, on_scanned=None):
+        """Analyze the pages or documents of one scan job concurrently, in order
+        
+        Returns a merged result with one entry per part and a summary that
+        walks through them in the same order.
+        """
+        futures = []
+        with ThreadPoolExecutor(max_workers=self.config["page_analysis_workers"],
+                                thread_name_prefix=f"{part}-analysis") as executor:
+            for scan in scans:
+                futures.append(executor.submit(self._analyze_scan, scan))
+            if on_scanned is not None:
+                on_scanned()
             
+            parts = []
+            for number, future in enumerate(futures, 1):
+                try:
+                    parts.append(dict(future.result(), **{part: number}))
+                except ScanQualityError as e:
+                    parts.append({part: number, "error": str(e), "rejected": e.problems})
+                except Exception as e:
+                    logger.error(f"Analysis of {part} {number} failed: {str(e)}")
+                    parts.append({part: number, "error": str(e)})
+        
+        if not any("error" not in entry for entry in parts):
+            if all("rejected" in entry for entry in parts):
+                raise ScanQualityError(sorted({problem for entry in parts for problem in entry["rejected"]}), {})
+            raise RuntimeError(f"Failed to analyze any {part}")
+        
+        analyzed = [entry for entry in parts if "error" not in entry]
+        return {
+            "document_type": "batch" if part == "page" else "multiple_documents",
+            f"{part}_count": len(parts),
+            "document_types": [entry["document_type"] for entry in analyzed],
+            "summary": " ".join(
+                f"{part.capitalize()} {entry[part]}: {entry['summary']}" for entry in analyzed if entry.get("summary")),
+            f"failed_{part}s": [entry[part] for entry in parts if "error" in entry],
+            f"rejected_{part}s": [entry[part] for entry in parts if "rejected" in entry],
+            f"{part}s": parts
+        }
+    
+    def _ensure_model(self, doc_type):
+        """Load the local model for doc_type on demand, False if it is unavailable"""
+        if self.model_manager is None or not self.model_manager.is_registered(doc_type):
+            return True
+        
+        try:
+            self.model_manager.ensure(doc_type)
+            return True
         except Exception as e:
-            logger.error(f"Analysis failed: {str(e)}")
-            raise RuntimeError(f"Failed to analyze document: {str(e)}")
+            logger.error(f"Failed to load {doc_type} model: {str(e)}")
+            if not self.config["use_api_fallback"]:
+                raise RuntimeError(f"Failed to load {doc_type} model and API fallback is disabled: {str(e)}")
+            logger.warning("Will use API fallback for analysis")
+            return False
     
-    def _detect_document_type(self, document_path):
+    def _detect_document_type(self, scan):
         """Detect the type of medical document"""
-        image = cv2.imread(document_path)
+        # The classifier settles most pages; OCR only confirms the ones it is unsure about.
+        # A streaming scan has run it already, and its OCR result is reused below
+        if self.type_classifier is not None:
+            doc_type, confidence = scan.hints.get("type_prediction") or self.type_classifier.predict(scan.image)
+            if confidence >= self.config["confidence_threshold"]:
+                return doc_type
+            logger.info(f"Type classifier unsure ({doc_type}, {confidence:.2f}), falling back to OCR")
+        
+        # Check for keywords to determine document type; the analyzers reuse this OCR
+        if self.config["roi_type_detection"]:
+            doc_type, _ = self._detect_type_from_bands(scan)
+        else:
+            doc_type = self._match_document_type(self._ocr(scan).text.lower())
+        return doc_type or "text_report"
+    
+    def _detect_type_from_bands(self, scan):
+        """Keyword-match the header band, then the footer band, then the rest of the page
         
-        # Extract text for classification
-        extracted_text = pytesseract.image_to_string(image)
+        Returns (document type or None, band that decided). Modality names sit
+        in the header on nearly every report, so most pages stop after one
+        small band. If all three bands run they are merged into the scan's
+        full-page OcrResult, so a lab report still reads each row only once.
+        """
+        if "ocr" in scan.hints:
+            return self._match_document_type(scan.hints["ocr"].text.lower()), "page"
         
-        # Check for keywords to determine document type
-        text_lower = extracted_text.lower()
+        height = scan.image.shape[0]
+        overlap = int(height * self.config["roi_overlap_fraction"])
+        header = int(height * self.config["roi_header_fraction"])
+        footer = max(header, height - int(height * self.config["roi_footer_fraction"]))
+        bands = [("header", 0, header), ("footer", footer, height)]
+        if footer > header:
+            bands.append(("page", max(0, header - overlap), min(height, footer + overlap)))
         
-        if "x-ray" in text_lower or "radiograph" in text_lower:
-            return "xray"
-        elif "mri" in text_lower or "magnetic resonance" in text_lower:
-            return "mri"
-        elif "ct scan" in text_lower or "computed tomography" in text_lower:
-            return "ct"
-        elif "
+        parts = []
+        for name, top, bottom in bands:
+            if bottom <= top:
+                continue
+            result = self._ocr_image(scan.image[top:bottom], origin=(0, top))
+            parts.append((result, top, bottom))
+            doc_type = self._match_document_type(result.text.lower())
+            if doc_type is not None:
+                logger.info(f"Found {doc_type} keywords in the {name} band")
+                return doc_type, name
+        
+        scan.hints["ocr"] = OcrResult.merge(sorted(parts, key=lambda part: part[1]))
+        return None, "page"
+    
+    def _ocr(self, scan):
+        """The scan's OcrResult, running Tesseract only the first time anything asks for it
+        
+        Kept in scan.hints["ocr"], so type detection, the text report analyzer
+        and the API fallback all read the same pass.
+        """
+        if "ocr" not in scan.hints:
+            start = time.time()
+            scan.hints["ocr"] = self._ocr_image(scan.image)
+            logger.info(f"OCR read {len(scan.hints['ocr'].words)} words in {time.time() - start:.2f}s")
+        return scan.hints["ocr"]
+    
+    def _ocr_image(self, image, origin=(0, 0)):
+        """OcrResult for an image, read as concurrent tiles when it is tall enough"""
+        tiles = min(self.config["ocr_workers"], image.shape[0] // self.config["ocr_min_tile_rows"])
+        if tiles < 2:
+            return OcrResult.from_image(image, self.config["ocr_language"], origin)
+        return OcrResult.from_tiles(image, self.config["ocr_language"], self.ocr_executor,
+                                    tiles, self.config["ocr_tile_overlap"], origin)
+    
+    def _match_document_type(self, text_lower):
+        """Map report text to a document type by keyword, None if nothing matches"""
+        found = {match.value for match in self.keyword_matcher.find_all(text_lower) if match.kind == "modality"}
+        return next((doc_type for doc_type in MODALITY_KEYWORDS if doc_type in found), None)
+    
+    def _find_medical_terms(self, text):
+        """(start, end, term) of every medical_terminology.json term in text, in the same single pass"""
+        return [(match.start, match.end, match.value)
+                for match in self.keyword_matcher.find_all(text) if match.kind == "term"]
+    
+    def _explain_medical_terms(self, text):
+        """Each terminology term in text, in order of first appearance, with its
+        definition from medical_terminology.json and the [start, end) spans
+        where it occurs"""
+        found = {}
+        for start, end, term in self._find_medical_terms(text):
+            found.setdefault(term, []).append([start, end])
+        definitions = self.medical_terms if isinstance(self.medical_terms, dict) else {}
+        return [{"term": term, "definition": definitions.get(term), "positions": positions}
+                for term, positions in found.items()]